@@ -36,6 +36,7 @@
 #include "libss7.h"
 #include "isup.h"
 #include "ss7_internal.h"
+#include "mtp2.h"
 #include "mtp3.h"
 
 #define FUNC_DUMP(name) int ((name))(struct ss7 *ss7, int messagetype, unsigned char *parm, int len)
@@ -58,12 +59,6 @@ struct parm_func {
 	FUNC_SEND(*transmit);
 };
 
-struct isup_timer_param {
-	struct ss7 *ss7;
-	struct isup_call *c;
-	int timer;
-};
-
 static int iam_params[] = {ISUP_PARM_NATURE_OF_CONNECTION_IND, ISUP_PARM_FORWARD_CALL_IND, ISUP_PARM_CALLING_PARTY_CAT,
 	ISUP_PARM_TRANSMISSION_MEDIUM_REQS, ISUP_PARM_CALLED_PARTY_NUM, ISUP_PARM_CALLING_PARTY_NUM, ISUP_PARM_REDIRECTING_NUMBER,
 	ISUP_PARM_REDIRECTION_INFO, ISUP_PARM_REDIRECT_COUNTER, ISUP_PARM_ORIGINAL_CALLED_NUM, ISUP_PARM_OPT_FORWARD_CALL_INDICATOR,
@@ -117,42 +112,43 @@ static struct message_data {
 	int opt_params;
 	int ansi_priority;
 	int *param_list;
+	int max_len;	/* most bytes after the message type we ever send, -1 if not bounded */
 } messages[] = {
-	{ISUP_IAM, 4, 1, 1, 0, iam_params},
-	{ISUP_ACM, 1, 0, 1, 1, acm_params},
-	{ISUP_ANM, 0, 0, 1, 2, anm_params},
-	{ISUP_CON, 1, 0, 1, -1, con_params},
-	{ISUP_REL, 0, 1, 1, 1, rel_params},
-	{ISUP_RLC, 0, 0, 1, 2, empty_params},
-	{ISUP_GRS, 0, 1, 0, 0, greset_params},
-	{ISUP_GRA, 0, 1, 0, 0, greset_params},
-	{ISUP_CGB, 1, 1, 0, 0, cicgroup_params},
-	{ISUP_CGU, 1, 1, 0, 0, cicgroup_params},
-	{ISUP_CGBA, 1, 1, 0, 0, cicgroup_params},
-	{ISUP_CGUA, 1, 1, 0, 0, cicgroup_params},
-	{ISUP_COT, 1, 0, 0, 1, cot_params},
-	{ISUP_CCR, 0, 0, 0, 1, empty_params},
-	{ISUP_BLO, 0, 0, 0, 0, empty_params},
-	{ISUP_LPA, 0, 0, 0, 1, empty_params},
-	{ISUP_UBL, 0, 0, 0, 0, empty_params},
-	{ISUP_BLA, 0, 0, 0, 0, empty_params},
-	{ISUP_UBA, 0, 0, 0, 0, empty_params},
-	{ISUP_RSC, 0, 0, 0, 0, empty_params},
-	{ISUP_CVR, 0, 0, 0, 0, empty_params},
-	{ISUP_CVT, 0, 0, 0, 0, empty_params},
-	{ISUP_CPG, 1, 0, 1, 1, cpg_params},
-	{ISUP_UCIC, 0, 0, 0, 1, empty_params},
-	{ISUP_CQM, 0, 1, 0, 0, greset_params},
-	{ISUP_CQR, 0, 2, 0, 0, cqr_params},
-	{ISUP_FRJ, 1, 0, 1, -1, frj_params},
-	{ISUP_FAA, 1, 0, 1, -1, faa_params},
-	{ISUP_FAR, 1, 0, 1, -1, far_params},
-	{ISUP_CFN, 0, 1, 1, 0, rel_params},
-	{ISUP_SUS, 1, 0, 1, 1, sus_res_params},
-	{ISUP_RES, 1, 0, 1, 1, sus_res_params},
-	{ISUP_INR, 1, 0, 0, 1, inr_params},
-	{ISUP_INF, 1, 0, 2, 1, inf_params},
-	{ISUP_SAM, 0, 1, 1, -1, sam_params}
+	{ISUP_IAM, 4, 1, 1, 0, iam_params, -1},
+	{ISUP_ACM, 1, 0, 1, 1, acm_params, 4},
+	{ISUP_ANM, 0, 0, 1, 2, anm_params, -1},
+	{ISUP_CON, 1, 0, 1, -1, con_params, -1},
+	{ISUP_REL, 0, 1, 1, 1, rel_params, 6},
+	{ISUP_RLC, 0, 0, 1, 2, empty_params, 2},
+	{ISUP_GRS, 0, 1, 0, 0, greset_params, 36},
+	{ISUP_GRA, 0, 1, 0, 0, greset_params, 36},
+	{ISUP_CGB, 1, 1, 0, 0, cicgroup_params, 36},
+	{ISUP_CGU, 1, 1, 0, 0, cicgroup_params, 36},
+	{ISUP_CGBA, 1, 1, 0, 0, cicgroup_params, 36},
+	{ISUP_CGUA, 1, 1, 0, 0, cicgroup_params, 36},
+	{ISUP_COT, 1, 0, 0, 1, cot_params, 1},
+	{ISUP_CCR, 0, 0, 0, 1, empty_params, 0},
+	{ISUP_BLO, 0, 0, 0, 0, empty_params, 0},
+	{ISUP_LPA, 0, 0, 0, 1, empty_params, 0},
+	{ISUP_UBL, 0, 0, 0, 0, empty_params, 0},
+	{ISUP_BLA, 0, 0, 0, 0, empty_params, 0},
+	{ISUP_UBA, 0, 0, 0, 0, empty_params, 0},
+	{ISUP_RSC, 0, 0, 0, 0, empty_params, 0},
+	{ISUP_CVR, 0, 0, 0, 0, empty_params, 0},
+	{ISUP_CVT, 0, 0, 0, 0, empty_params, 0},
+	{ISUP_CPG, 1, 0, 1, 1, cpg_params, -1},
+	{ISUP_UCIC, 0, 0, 0, 1, empty_params, 0},
+	{ISUP_CQM, 0, 1, 0, 0, greset_params, 36},
+	{ISUP_CQR, 0, 2, 0, 0, cqr_params, -1},
+	{ISUP_FRJ, 1, 0, 1, -1, frj_params, 11},
+	{ISUP_FAA, 1, 0, 1, -1, faa_params, 11},
+	{ISUP_FAR, 1, 0, 1, -1, far_params, 11},
+	{ISUP_CFN, 0, 1, 1, 0, rel_params, 6},
+	{ISUP_SUS, 1, 0, 1, 1, sus_res_params, 11},
+	{ISUP_RES, 1, 0, 1, 1, sus_res_params, 11},
+	{ISUP_INR, 1, 0, 0, 1, inr_params, -1},
+	{ISUP_INF, 1, 0, 2, 1, inf_params, -1},
+	{ISUP_SAM, 0, 1, 1, -1, sam_params, -1}
 };
 
 static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagetype, int parms[]);
@@ -235,7 +231,7 @@ static char * message2str(unsigned char message)
 	}
 }
 
-static char * isup_timer2str(int timer)
+char * isup_timer2str(int timer)
 {
 	switch (timer) {
 		case ISUP_TIMER_T1:
@@ -1162,6 +1158,11 @@ static FUNC_SEND(range_and_status_transmit)
 	int i, statuslen = 0;
 	int numcics = c->range + 1;
 
+	if (c->range < 0 || numcics > sizeof(c->status)) {
+		ss7_error(ss7, "Range %d is out of bounds\n", c->range);
+		return -1;
+	}
+
 	parm[0] = c->range & 0xff;
 
 	/* No status for these messages */
@@ -2200,6 +2201,11 @@ static FUNC_SEND(circuit_state_ind_transmit)
 {
 	int numcics = c->range + 1, i;
 
+	if (c->range < 0 || numcics > sizeof(c->status) || numcics > len) {
+		ss7_error(ss7, "Range %d is out of bounds\n", c->range);
+		return -1;
+	}
+
 	for (i = 0; i < numcics; i++) {
 		parm[i] = c->status[i];
 	}
@@ -3030,6 +3036,226 @@ void isup_set_calling_party_category(struct isup_call *c, unsigned int category)
 	c->calling_party_cat = category;
 }
 
+/* Call related gets, for SS7_EVENT_NOCOPY events.  The out parameters may be NULL. */
+const char *isup_get_called(const struct isup_call *c, unsigned char *called_nai)
+{
+	if (called_nai) {
+		*called_nai = c->called_nai;
+	}
+	return c->called_party_num;
+}
+
+const char *isup_get_calling(const struct isup_call *c, unsigned char *calling_nai, unsigned char *presentation_ind, unsigned char *screening_ind)
+{
+	if (calling_nai) {
+		*calling_nai = c->calling_nai;
+	}
+	if (presentation_ind) {
+		*presentation_ind = c->presentation_ind;
+	}
+	if (screening_ind) {
+		*screening_ind = c->screening_ind;
+	}
+	return c->calling_party_num;
+}
+
+const char *isup_get_connected(const struct isup_call *c, unsigned char *connected_nai, unsigned char *connected_presentation_ind, unsigned char *connected_screening_ind)
+{
+	if (connected_nai) {
+		*connected_nai = c->connected_nai;
+	}
+	if (connected_presentation_ind) {
+		*connected_presentation_ind = c->connected_presentation_ind;
+	}
+	if (connected_screening_ind) {
+		*connected_screening_ind = c->connected_screening_ind;
+	}
+	return c->connected_num;
+}
+
+const char *isup_get_redirecting_number(const struct isup_call *c, unsigned char *redirecting_num_nai, unsigned char *redirecting_num_presentation_ind, unsigned char *redirecting_num_screening_ind)
+{
+	if (redirecting_num_nai) {
+		*redirecting_num_nai = c->redirecting_num_nai;
+	}
+	if (redirecting_num_presentation_ind) {
+		*redirecting_num_presentation_ind = c->redirecting_num_presentation_ind;
+	}
+	if (redirecting_num_screening_ind) {
+		*redirecting_num_screening_ind = c->redirecting_num_screening_ind;
+	}
+	return c->redirecting_num;
+}
+
+int isup_get_redirection_info(const struct isup_call *c, unsigned char *redirect_info_ind, unsigned char *redirect_info_orig_reas,
+	unsigned char *redirect_info_counter, unsigned char *redirect_info_reas)
+{
+	if (redirect_info_ind) {
+		*redirect_info_ind = c->redirect_info_ind;
+	}
+	if (redirect_info_orig_reas) {
+		*redirect_info_orig_reas = c->redirect_info_orig_reas;
+	}
+	if (redirect_info_counter) {
+		*redirect_info_counter = c->redirect_info_counter;
+	}
+	if (redirect_info_reas) {
+		*redirect_info_reas = c->redirect_info_reas;
+	}
+	return c->redirect_info;
+}
+
+unsigned char isup_get_redirect_counter(const struct isup_call *c)
+{
+	return c->redirect_counter;
+}
+
+const char *isup_get_orig_called_num(const struct isup_call *c, unsigned char *orig_called_nai, unsigned char *orig_called_pres_ind, unsigned char *orig_called_screening_ind)
+{
+	if (orig_called_nai) {
+		*orig_called_nai = c->orig_called_nai;
+	}
+	if (orig_called_pres_ind) {
+		*orig_called_pres_ind = c->orig_called_pres_ind;
+	}
+	if (orig_called_screening_ind) {
+		*orig_called_screening_ind = c->orig_called_screening_ind;
+	}
+	return c->orig_called_num;
+}
+
+int isup_get_tmr(const struct isup_call *c)
+{
+	return c->transcap;
+}
+
+const char *isup_get_charge(const struct isup_call *c, unsigned char *charge_nai, unsigned char *charge_num_plan)
+{
+	if (charge_nai) {
+		*charge_nai = c->charge_nai;
+	}
+	if (charge_num_plan) {
+		*charge_num_plan = c->charge_num_plan;
+	}
+	return c->charge_number;
+}
+
+int isup_get_oli(const struct isup_call *c)
+{
+	return c->oli_ani2;
+}
+
+const char *isup_get_gen_address(const struct isup_call *c, unsigned char *gen_add_nai, unsigned char *gen_pres_ind, unsigned char *gen_num_plan, unsigned char *gen_add_type)
+{
+	if (gen_add_nai) {
+		*gen_add_nai = c->gen_add_nai;
+	}
+	if (gen_pres_ind) {
+		*gen_pres_ind = c->gen_add_pres_ind;
+	}
+	if (gen_num_plan) {
+		*gen_num_plan = c->gen_add_num_plan;
+	}
+	if (gen_add_type) {
+		*gen_add_type = c->gen_add_type;
+	}
+	return c->gen_add_number;
+}
+
+const char *isup_get_gen_digits(const struct isup_call *c, unsigned char *gen_dig_type, unsigned char *gen_dig_scheme)
+{
+	if (gen_dig_type) {
+		*gen_dig_type = c->gen_dig_type;
+	}
+	if (gen_dig_scheme) {
+		*gen_dig_scheme = c->gen_dig_scheme;
+	}
+	return c->gen_dig_number;
+}
+
+const char *isup_get_cug(const struct isup_call *c, unsigned char *cug_indicator, unsigned short *cug_interlock_code)
+{
+	if (cug_indicator) {
+		*cug_indicator = c->cug_indicator;
+	}
+	if (cug_interlock_code) {
+		*cug_interlock_code = c->cug_interlock_code;
+	}
+	return c->cug_interlock_ni;
+}
+
+/* The echo control indicator received from the remote end */
+unsigned char isup_get_echocontrol(const struct isup_call *c)
+{
+	return c->echocontrol_ind;
+}
+
+const char *isup_get_generic_name(const struct isup_call *c, unsigned int *typeofname, unsigned int *availability, unsigned int *presentation)
+{
+	if (typeofname) {
+		*typeofname = c->generic_name_typeofname;
+	}
+	if (availability) {
+		*availability = c->generic_name_avail;
+	}
+	if (presentation) {
+		*presentation = c->generic_name_presentation;
+	}
+	return c->generic_name;
+}
+
+const char *isup_get_jip_digits(const struct isup_call *c)
+{
+	return c->jip_number;
+}
+
+const char *isup_get_lspi(const struct isup_call *c, unsigned char *lspi_type, unsigned char *lspi_scheme, unsigned char *lspi_context)
+{
+	if (lspi_type) {
+		*lspi_type = c->lspi_type;
+	}
+	if (lspi_scheme) {
+		*lspi_scheme = c->lspi_scheme;
+	}
+	if (lspi_context) {
+		*lspi_context = c->lspi_context;
+	}
+	return c->lspi_ident;
+}
+
+void isup_get_callref(const struct isup_call *c, unsigned int *call_ref_ident, unsigned int *call_ref_pc)
+{
+	if (call_ref_ident) {
+		*call_ref_ident = c->call_ref_ident;
+	}
+	if (call_ref_pc) {
+		*call_ref_pc = c->call_ref_pc;
+	}
+}
+
+unsigned int isup_get_calling_party_category(const struct isup_call *c)
+{
+	return c->calling_party_cat;
+}
+
+unsigned char isup_get_called_party_status(const struct isup_call *c)
+{
+	return c->called_party_status_ind;
+}
+
+void isup_get_cot(const struct isup_call *c, int *cot_check_required, int *cot_performed_on_previous_cic, int *cot_check_passed)
+{
+	if (cot_check_required) {
+		*cot_check_required = c->cot_check_required;
+	}
+	if (cot_performed_on_previous_cic) {
+		*cot_performed_on_previous_cic = c->cot_performed_on_previous_cic;
+	}
+	if (cot_check_passed) {
+		*cot_check_passed = c->cot_check_passed;
+	}
+}
+
 static struct isup_call * isup_find_call(struct ss7 *ss7, struct routing_label *rl, int cic)
 {
 	struct isup_call *cur = ss7->calls;
@@ -3075,6 +3301,26 @@ void isup_free_call(struct ss7 *ss7, struct isup_call *c)
 	}
 }
 
+/* Encode a parameter into scratch space and only copy it out if it fits in
+ * maxlen, the encoders themselves don't know where the message ends */
+static int parm_transmit(struct ss7 *ss7, struct isup_call *c, int message, struct parm_func *p, unsigned char *parmbuf, int maxlen)
+{
+	unsigned char tmp[ISUP_PARM_MAX_LEN];
+	int res;
+
+	memset(tmp, 0, sizeof(tmp));
+	res = p->transmit(ss7, c, message, tmp, sizeof(tmp));
+	if (res > maxlen) {
+		ss7_error(ss7, "No room for parameter '%s' (%d bytes, %d left)\n", param2str(p->parm), res, maxlen < 0 ? 0 : maxlen);
+		return -1;
+	}
+	if (res > 0) {
+		memcpy(parmbuf, tmp, res);
+	}
+
+	return res;
+}
+
 static int do_parm(struct ss7 *ss7, struct isup_call *c, int message, int parm, unsigned char *parmbuf, int maxlen, int parmtype, int tx)
 {
 	struct isup_parm_opt *optparm = NULL;
@@ -3088,13 +3334,13 @@ static int do_parm(struct ss7 *ss7, struct isup_call *c, int message, int parm,
 				switch (parmtype) {
 					case PARM_TYPE_FIXED:
 						if (tx) {
-							return parms[x].transmit(ss7, c, message, parmbuf, maxlen);
+							return parm_transmit(ss7, c, message, &parms[x], parmbuf, maxlen);
 						} else {
 							return parms[x].receive(ss7, c, message, parmbuf, maxlen);
 						}
 					case PARM_TYPE_VARIABLE:
 						if (tx) {
-							res = parms[x].transmit(ss7, c, message, parmbuf + 1, maxlen);
+							res = parm_transmit(ss7, c, message, &parms[x], parmbuf + 1, maxlen - 1);
 							if (res > 0) {
 								parmbuf[0] = res;
 								return res + 1;
@@ -3108,9 +3354,9 @@ static int do_parm(struct ss7 *ss7, struct isup_call *c, int message, int parm,
 					case PARM_TYPE_OPTIONAL:
 						optparm = (struct isup_parm_opt *)parmbuf;
 						if (tx) {
-							optparm->type = parms[x].parm;
-							res = parms[x].transmit(ss7, c, message, optparm->data, maxlen);
+							res = parm_transmit(ss7, c, message, &parms[x], optparm->data, maxlen - 2);
 							if (res > 0) {
+								optparm->type = parms[x].parm;
 								optparm->len = res;
 							} else {
 								return res;
@@ -3186,7 +3432,7 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 	int rlsize;
 	unsigned char *varoffsets = NULL, *opt_ptr;
 	int fixedparams = 0, varparams = 0, optparams = 0;
-	int len = sizeof(struct ss7_msg);
+	int len;
 	struct routing_label rl;
 	int res = 0;
 	int offset = 0;
@@ -3194,8 +3440,24 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 	int i = 0;
 	int priority = -1;
 
+	/* Find the metadata for our message */
+	for (x = 0; x < sizeof(messages)/sizeof(struct message_data); x++) {
+		if (messages[x].messagetype == messagetype) {
+			ourmessage = x;
+		}
+	}
+
+	if (ourmessage < 0) {
+		ss7_error(ss7, "Unable to find message %d in message list!\n", messagetype);
+		return -1;
+	}
+
 	/* Do init stuff */
-	msg = ss7_msg_new();
+	if (messages[ourmessage].max_len > -1) {
+		msg = ss7_msg_new(ss7, RL_MAX_SIZE + CIC_SIZE + 1 + messages[ourmessage].max_len);
+	} else {
+		msg = ss7_msg_new(ss7, SIF_MAX_SIZE);
+	}
 
 	if (!msg) {
 		ss7_error(ss7, "Allocation failed!\n");
@@ -3212,6 +3474,7 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 	rl.type = ss7->switchtype;
 	rlsize = set_routinglabel(rlptr, &rl);
 	mh = (struct isup_h *)(rlptr + rlsize);	/* Note to self, do NOT put a typecasted pointer next to an addition operation */
+	len = ss7_msg_userpart_max(msg) - rlsize - CIC_SIZE - 1;
 
 	/* Set the CIC - ITU style */
 	if (ss7->switchtype == SS7_ITU) {
@@ -3223,17 +3486,6 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 	}
 
 	mh->type = messagetype;
-	/* Find the metadata for our message */
-	for (x = 0; x < sizeof(messages)/sizeof(struct message_data); x++) {
-		if (messages[x].messagetype == messagetype) {
-			ourmessage = x;
-		}
-	}
-
-	if (ourmessage < 0) {
-		ss7_error(ss7, "Unable to find message %d in message list!\n", mh->type);
-		return -1;
-	}
 
 	fixedparams = messages[ourmessage].mand_fixed_params;
 	varparams = messages[ourmessage].mand_var_params;
@@ -3260,6 +3512,7 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 
 		if (res < 0) {
 			ss7_error(ss7, "!! Unable to add mandatory fixed parameter '%s'\n", param2str(parms[x]));
+			ss7_msg_free(ss7, msg);
 			return -1;
 		}
 
@@ -3279,6 +3532,12 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 		len -= varparams;
 	}
 
+	if (len < 0) {
+		ss7_error(ss7, "!! No room for the parameter pointers\n");
+		ss7_msg_free(ss7, msg);
+		return -1;
+	}
+
 	/* Whew, some complicated math for all of these offsets and different sections */
 	for (; (x - fixedparams) < varparams; x++) {
 		varoffsets[i] = &mh->data[offset] - &varoffsets[i];
@@ -3287,6 +3546,7 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 
 		if (res < 0) {
 			ss7_error(ss7, "!! Unable to add mandatory variable parameter '%s'\n", param2str(parms[x]));
+			ss7_msg_free(ss7, msg);
 			return -1;
 		}
 
@@ -3304,6 +3564,7 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 
 			if (res < 0) {
 				ss7_error(ss7, "!! Unable to add optional parameter '%s'\n", param2str(parms[x]));
+				ss7_msg_free(ss7, msg);
 				return -1;
 			}
 
@@ -3316,6 +3577,11 @@ static int isup_send_message(struct ss7 *ss7, struct isup_call *c, int messagety
 		}
 
 		if (addedparms) {
+			if (len < 1) {
+				ss7_error(ss7, "!! No room for the end of optional parameters\n");
+				ss7_msg_free(ss7, msg);
+				return -1;
+			}
 			*opt_ptr = &mh->data[offsetbegins] - opt_ptr;
 			/* Add end of optional parameters */
 			mh->data[offset++] = 0;
@@ -3625,23 +3891,24 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_SAM);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_SAM;
 			e->sam.cic = c->cic;
 			e->sam.call = c;
 			e->sam.opc = opc;	/* keep OPC information */
-			strncpy(e->sam.called_party_num, c->called_party_num, sizeof(e->sam.called_party_num));
-			e->sam.called_nai = c->called_nai;
 			e->sam.got_sent_msg = c->got_sent_msg;
-			e->sam.cot_check_passed = c->cot_check_passed;
-			e->sam.cot_check_required = c->cot_check_required;
-			e->sam.cot_performed_on_previous_cic = c->cot_performed_on_previous_cic;
+			if (!(ss7->flags & SS7_EVENT_NOCOPY)) {
+				strncpy(e->sam.called_party_num, c->called_party_num, sizeof(e->sam.called_party_num));
+				e->sam.called_nai = c->called_nai;
+				e->sam.cot_check_passed = c->cot_check_passed;
+				e->sam.cot_check_required = c->cot_check_required;
+				e->sam.cot_performed_on_previous_cic = c->cot_performed_on_previous_cic;
+			}
 			isup_start_timer(ss7, c, ISUP_TIMER_T35);
 			return 0;
 		case ISUP_INF:
@@ -3683,28 +3950,26 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			}
 			return 0;
 		case ISUP_CQM:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CQM);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_CQM;
 			e->cqm.startcic = cic;
 			e->cqm.endcic = cic + c->range;
 			e->cqm.opc = opc;	/* keep OPC information */
 			e->cqm.call = c;
 			return 0;
 		case ISUP_GRS:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_GRS);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_GRS;
 			e->grs.startcic = cic;
 			e->grs.endcic = cic + c->range;
 			e->grs.opc = opc;	/* keep OPC information */
@@ -3721,14 +3986,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return 0;
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_GRA);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_GRA;
 			e->gra.startcic = cic;
 			e->gra.endcic = cic + c->range;
 			for (i = 0; i < (c->range + 1); i++) {
@@ -3751,7 +4015,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				ss7_debug_msg(ss7, SS7_DEBUG_ISUP, "Got RSC on CIC %d DPC %d, but we have sent RSC too.\n", c->cic, opc);
 				return isup_send_message(ss7, c, ISUP_RLC, empty_params);
 			}
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_RSC);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -3759,7 +4023,6 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			}
 
 			isup_stop_all_timers(ss7, c);
-			e->e = ISUP_EVENT_RSC;
 			e->rsc.cic = cic;
 			e->rsc.call = c;
 			e->rsc.opc = opc;	/* keep OPC information */
@@ -3767,7 +4030,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			c->got_sent_msg = 0;
 			return 0;
 		case ISUP_REL:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_REL);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -3780,7 +4043,6 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			isup_stop_timer(ss7, c, ISUP_TIMER_T35);
 			isup_stop_timer(ss7, c, ISUP_TIMER_T10);
 			c->got_sent_msg &= ~(ISUP_CALL_CONNECTED | ISUP_CALL_PENDING);
-			e->e = ISUP_EVENT_REL;
 			e->rel.cic = c->cic;
 			e->rel.call = c;
 			e->rel.cause = c->cause;
@@ -3793,7 +4055,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_ACM);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -3802,15 +4064,16 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 
 			isup_stop_timer(ss7, c, ISUP_TIMER_T7);
 			c->got_sent_msg |= ISUP_GOT_ACM;
-			e->e = ISUP_EVENT_ACM;
 			e->acm.cic = c->cic;
-			e->acm.call_ref_ident = c->call_ref_ident;
-			e->acm.call_ref_pc = c->call_ref_pc;
 			e->acm.call = c;
 			e->acm.opc = opc;	/* keep OPC information */
-			e->acm.called_party_status_ind = c->called_party_status_ind;
-			e->acm.echocontrol_ind = c->echocontrol_ind;
 			e->acm.got_sent_msg = c->got_sent_msg;
+			if (!(ss7->flags & SS7_EVENT_NOCOPY)) {
+				e->acm.call_ref_ident = c->call_ref_ident;
+				e->acm.call_ref_pc = c->call_ref_pc;
+				e->acm.called_party_status_ind = c->called_party_status_ind;
+				e->acm.echocontrol_ind = c->echocontrol_ind;
+			}
 			return 0;
 		case ISUP_CON:
 			if (!(c->got_sent_msg & ISUP_SENT_IAM)) {
@@ -3818,7 +4081,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CON);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -3827,16 +4090,17 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 
 			isup_stop_timer(ss7, c, ISUP_TIMER_T7);
 			c->got_sent_msg |= ISUP_GOT_CON;
-			e->e = ISUP_EVENT_CON;
 			e->con.cic = c->cic;
 			e->con.call = c;
 			e->con.opc = opc;	/* keep OPC information */
-			e->con.connected_nai = c->connected_nai;
-			e->con.connected_presentation_ind = c->connected_presentation_ind;
-			e->con.connected_screening_ind = c->connected_screening_ind;
-			strncpy(e->con.connected_num, c->connected_num, sizeof(e->con.connected_num));
-			e->con.echocontrol_ind = c->echocontrol_ind;
 			e->con.got_sent_msg = c->got_sent_msg;
+			if (!(ss7->flags & SS7_EVENT_NOCOPY)) {
+				e->con.connected_nai = c->connected_nai;
+				e->con.connected_presentation_ind = c->connected_presentation_ind;
+				e->con.connected_screening_ind = c->connected_screening_ind;
+				strncpy(e->con.connected_num, c->connected_num, sizeof(e->con.connected_num));
+				e->con.echocontrol_ind = c->echocontrol_ind;
+			}
 			return 0;
 		case ISUP_ANM:
 			if (!(c->got_sent_msg & ISUP_SENT_IAM)) {
@@ -3844,7 +4108,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_ANM);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -3852,16 +4116,17 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			}
 
 			c->got_sent_msg |= ISUP_GOT_ANM;
-			e->e = ISUP_EVENT_ANM;
 			e->anm.cic = c->cic;
 			e->anm.call = c;
 			e->anm.opc = opc;	/* keep OPC information */
-			e->anm.connected_nai = c->connected_nai;
-			e->anm.connected_presentation_ind = c->connected_presentation_ind;
-			e->anm.connected_screening_ind = c->connected_screening_ind;
-			strncpy(e->anm.connected_num, c->connected_num, sizeof(e->anm.connected_num));
-			e->anm.echocontrol_ind = c->echocontrol_ind;
 			e->anm.got_sent_msg = c->got_sent_msg;
+			if (!(ss7->flags & SS7_EVENT_NOCOPY)) {
+				e->anm.connected_nai = c->connected_nai;
+				e->anm.connected_presentation_ind = c->connected_presentation_ind;
+				e->anm.connected_screening_ind = c->connected_screening_ind;
+				strncpy(e->anm.connected_num, c->connected_num, sizeof(e->anm.connected_num));
+				e->anm.echocontrol_ind = c->echocontrol_ind;
+			}
 			return 0;
 		case ISUP_RLC:
 			if (!(c->got_sent_msg & (ISUP_SENT_REL | ISUP_SENT_RSC))) {
@@ -3869,14 +4134,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_RLC);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_RLC;
 			e->rlc.cic = c->cic;
 			e->rlc.opc = opc;	/* keep OPC information */
 			e->rlc.call = c;
@@ -3900,14 +4164,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_COT);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_COT;
 			e->cot.cic = c->cic;
 			e->cot.passed = c->cot_check_passed;
 			e->cot.cot_performed_on_previous_cic = c->cot_performed_on_previous_cic;
@@ -3924,7 +4187,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			}
 			return 0;
 		case ISUP_CCR:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CCR);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -3932,7 +4195,6 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			}
 
 			c->got_sent_msg |= ISUP_GOT_CCR;
-			e->e = ISUP_EVENT_CCR;
 			e->ccr.cic = c->cic;
 			e->ccr.opc = opc;	/* keep OPC information */
 			e->ccr.call = c;
@@ -3940,40 +4202,37 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			isup_stop_timer(ss7, c, ISUP_TIMER_T27);
 			return 0;
 		case ISUP_CVT:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CVT);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_CVT;
 			e->cvt.cic = c->cic;
 			e->cvt.call = c;
 			return 0;
 		case ISUP_BLO:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_BLO);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_BLO;
 			e->blo.cic = c->cic;
 			e->blo.opc = opc;	/* keep OPC information */
 			e->blo.call = c;
 			e->blo.got_sent_msg = c->got_sent_msg;
 			return 0;
 		case ISUP_UBL:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_UBL);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_UBL;
 			e->ubl.cic = c->cic;
 			e->ubl.opc = opc;	/* keep OPC information */
 			e->ubl.call = c;
@@ -3984,7 +4243,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_BLA);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -3994,7 +4253,6 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			isup_stop_timer(ss7, c, ISUP_TIMER_T12);
 			isup_stop_timer(ss7, c, ISUP_TIMER_T13);
 
-			e->e = ISUP_EVENT_BLA;
 			e->bla.cic = c->cic;
 			e->bla.opc = opc;	/* keep OPC information */
 			e->bla.call = c;
@@ -4002,14 +4260,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			c->got_sent_msg &= ~ISUP_SENT_BLO;
 			return 0;
 		case ISUP_LPA:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_LPA);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_LPA;
 			e->lpa.cic = c->cic;
 			e->lpa.opc = opc;	/* keep OPC information */
 			e->lpa.call = c;
@@ -4020,7 +4277,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_UBA);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -4030,7 +4287,6 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			isup_stop_timer(ss7, c, ISUP_TIMER_T14);
 			isup_stop_timer(ss7, c, ISUP_TIMER_T15);
 
-			e->e = ISUP_EVENT_UBA;
 			e->uba.cic = c->cic;
 			e->uba.opc = opc;	/* keep OPC information */
 			e->uba.call = c;
@@ -4038,14 +4294,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			c->got_sent_msg &= ~ISUP_SENT_UBL;
 			return 0;
 		case ISUP_CGB:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CGB);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_CGB;
 			e->cgb.startcic = cic;
 			e->cgb.endcic = cic + c->range;
 			e->cgb.type = c->cicgroupsupervisiontype;
@@ -4057,14 +4312,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			e->cgb.call = c;
 			return 0;
 		case ISUP_CGU:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CGU);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_CGU;
 			e->cgu.startcic = cic;
 			e->cgu.endcic = cic + c->range;
 			e->cgu.type = c->cicgroupsupervisiontype;
@@ -4081,14 +4335,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CPG);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_CPG;
 			e->cpg.cic = c->cic;
 			e->cpg.opc = opc;	/* keep OPC information */
 			e->cpg.event = c->event_info;
@@ -4101,27 +4354,25 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			strncpy(e->cpg.connected_num, c->connected_num, sizeof(e->cpg.connected_num));
 			return 0;
 		case ISUP_UCIC:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_UCIC);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_UCIC;
 			e->ucic.cic = c->cic;
 			e->ucic.opc = opc;	/* keep OPC information */
 			e->ucic.call = c;
 			return 0;
 		case ISUP_FRJ:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_FRJ);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_FRJ;
 			e->frj.cic = c->cic;
 			e->frj.call_ref_ident = c->call_ref_ident;
 			e->frj.call_ref_pc = c->call_ref_pc;
@@ -4129,14 +4380,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			e->frj.call = c;
 			return 0;
 		case ISUP_FAA:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_FAA);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_FAA;
 			e->faa.cic = c->cic;
 			e->faa.call_ref_ident = c->call_ref_ident;
 			e->faa.call_ref_pc = c->call_ref_pc;
@@ -4144,14 +4394,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 			e->faa.call = c;
 			return 0;
 		case ISUP_FAR:
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_FAR);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_FAR;
 			e->far.cic = c->cic;
 			e->far.call_ref_ident = c->call_ref_ident;
 			e->far.call_ref_pc = c->call_ref_pc;
@@ -4169,14 +4418,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				ss7_message(ss7, "Got CGBA doesn't match with the sent CGB on CIC %d DPC %d\n", c->cic, opc);
 				return 0;
 			}
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CGBA);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_CGBA;
 			e->cgba.startcic = c->cic;
 			e->cgba.endcic = c->cic + c->range;
 			e->cgba.sent_endcic = c->sent_cgb_endcic;
@@ -4203,14 +4451,13 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return 0;
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_CGUA);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
 				return -1;
 			}
 
-			e->e = ISUP_EVENT_CGUA;
 			e->cgua.startcic = c->cic;
 			e->cgua.endcic = c->cic + c->range;
 			e->cgua.sent_endcic = c->sent_cgu_endcic;
@@ -4235,7 +4482,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				return isup_handle_unexpected(ss7, c, opc);
 			}
 
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_SUS);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -4248,7 +4495,6 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				isup_start_timer(ss7, c, ISUP_TIMER_T2);
 			}
 
-			e->e = ISUP_EVENT_SUS;
 			e->sus.cic = c->cic;
 			e->sus.opc = opc;	/* keep OPC information */
 			e->sus.call = c;
@@ -4260,7 +4506,7 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				ss7_message(ss7, "Got RES but no call on CIC %d PC %d ", c->cic, opc);
 				return isup_handle_unexpected(ss7, c, opc);
 			}
-			e = ss7_next_empty_event(ss7);
+			e = ss7_next_empty_event(ss7, ISUP_EVENT_RES);
 			if (!e) {
 				ss7_call_null(ss7, c, 1);
 				isup_free_call(ss7, c);
@@ -4273,7 +4519,6 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 				isup_stop_timer(ss7, c, ISUP_TIMER_T2);
 			}
 
-			e->e = ISUP_EVENT_RES;
 			e->res.cic = c->cic;
 			e->res.opc = opc;	/* keep OPC information */
 			e->res.call = c;
@@ -4288,6 +4533,62 @@ int isup_receive(struct ss7 *ss7, struct mtp2 *link, struct routing_label *rl, u
 	}
 }
 
+/* Copy the call details of an IAM into iam, for SS7_EVENT_NOCOPY users that
+ * want the whole event after all.  The cic, call, opc and got_sent_msg fields
+ * are left alone. */
+void isup_get_iam(const struct isup_call *c, ss7_event_iam *iam)
+{
+	iam->transcap = c->transcap;
+	iam->cot_check_required = c->cot_check_required;
+	iam->cot_performed_on_previous_cic = c->cot_performed_on_previous_cic;
+	strncpy(iam->called_party_num, c->called_party_num, sizeof(iam->called_party_num));
+	iam->called_nai = c->called_nai;
+	strncpy(iam->calling_party_num, c->calling_party_num, sizeof(iam->calling_party_num));
+	iam->calling_nai = c->calling_nai;
+	iam->presentation_ind = c->presentation_ind;
+	iam->screening_ind = c->screening_ind;
+	strncpy(iam->charge_number, c->charge_number, sizeof(iam->charge_number));
+	iam->charge_nai = c->charge_nai;
+	iam->charge_num_plan = c->charge_num_plan;
+	iam->oli_ani2 = c->oli_ani2;
+	iam->gen_add_nai = c->gen_add_nai;
+	iam->gen_add_num_plan = c->gen_add_num_plan;
+	strncpy(iam->gen_add_number, c->gen_add_number, sizeof(iam->gen_add_number));
+	iam->gen_add_pres_ind = c->gen_add_pres_ind;
+	iam->gen_add_type = c->gen_add_type;
+	strncpy(iam->gen_dig_number, c->gen_dig_number, sizeof(iam->gen_dig_number));
+	iam->gen_dig_type = c->gen_dig_type;
+	iam->gen_dig_scheme = c->gen_dig_scheme;
+	strncpy(iam->jip_number, c->jip_number, sizeof(iam->jip_number));
+	strncpy(iam->generic_name, c->generic_name, sizeof(iam->generic_name));
+	iam->generic_name_typeofname = c->generic_name_typeofname;
+	iam->generic_name_avail = c->generic_name_avail;
+	iam->generic_name_presentation = c->generic_name_presentation;
+	iam->lspi_type = c->lspi_type;
+	iam->lspi_scheme = c->lspi_scheme;
+	iam->lspi_context = c->lspi_context;
+	strncpy(iam->lspi_ident, c->lspi_ident, sizeof(iam->lspi_ident));
+	strncpy(iam->orig_called_num, c->orig_called_num, sizeof(iam->orig_called_num));
+	iam->orig_called_nai = c->orig_called_nai;
+	iam->orig_called_pres_ind = c->orig_called_pres_ind;
+	iam->orig_called_screening_ind = c->orig_called_screening_ind;
+	strncpy(iam->redirecting_num, c->redirecting_num, sizeof(iam->redirecting_num));
+	iam->redirecting_num_nai = c->redirecting_num_nai;
+	iam->redirecting_num_presentation_ind = c->redirecting_num_presentation_ind;
+	iam->redirecting_num_screening_ind = c->redirecting_num_screening_ind;
+	iam->redirect_counter = c->redirect_counter;
+	iam->redirect_info = c->redirect_info;
+	iam->redirect_info_ind = c->redirect_info_ind;
+	iam->redirect_info_orig_reas = c->redirect_info_orig_reas;
+	iam->redirect_info_counter = c->redirect_info_counter;
+	iam->redirect_info_reas = c->redirect_info_reas;
+	iam->calling_party_cat = c->calling_party_cat;
+	iam->cug_indicator = c->cug_indicator;
+	iam->cug_interlock_code = c->cug_interlock_code;
+	strncpy(iam->cug_interlock_ni, c->cug_interlock_ni, sizeof(iam->cug_interlock_ni));
+	iam->echocontrol_ind = c->echocontrol_ind;
+}
+
 int isup_event_iam(struct ss7 *ss7, struct isup_call *c, int opc)
 {
 	ss7_event *e;
@@ -4314,7 +4615,7 @@ int isup_event_iam(struct ss7 *ss7, struct isup_call *c, int opc)
 		return 0;
 	}
 
-	e = ss7_next_empty_event(ss7);
+	e = ss7_next_empty_event(ss7, ISUP_EVENT_IAM);
 	if (!e) {
 		ss7_call_null(ss7, c, 1);
 		isup_free_call(ss7, c);
@@ -4325,61 +4626,14 @@ int isup_event_iam(struct ss7 *ss7, struct isup_call *c, int opc)
 		c->got_sent_msg |= ISUP_GOT_CCR;
 	}
 
-	e->e = ISUP_EVENT_IAM;
 	e->iam.got_sent_msg = c->got_sent_msg;
 	e->iam.cic = c->cic;
-	e->iam.transcap = c->transcap;
-	e->iam.cot_check_required = c->cot_check_required;
-	e->iam.cot_performed_on_previous_cic = c->cot_performed_on_previous_cic;
-	c->cot_check_passed = 0;
-	strncpy(e->iam.called_party_num, c->called_party_num, sizeof(e->iam.called_party_num));
-	e->iam.called_nai = c->called_nai;
-	strncpy(e->iam.calling_party_num, c->calling_party_num, sizeof(e->iam.calling_party_num));
-	e->iam.calling_nai = c->calling_nai;
-	e->iam.presentation_ind = c->presentation_ind;
-	e->iam.screening_ind = c->screening_ind;
-	strncpy(e->iam.charge_number, c->charge_number, sizeof(e->iam.charge_number));
-	e->iam.charge_nai = c->charge_nai;
-	e->iam.charge_num_plan = c->charge_num_plan;
-	e->iam.oli_ani2 = c->oli_ani2;
-	e->iam.gen_add_nai = c->gen_add_nai;
-	e->iam.gen_add_num_plan = c->gen_add_num_plan;
-	strncpy(e->iam.gen_add_number, c->gen_add_number, sizeof(e->iam.gen_add_number));
-	e->iam.gen_add_pres_ind = c->gen_add_pres_ind;
-	e->iam.gen_add_type = c->gen_add_type;
-	strncpy(e->iam.gen_dig_number, c->gen_dig_number, sizeof(e->iam.gen_dig_number));
-	e->iam.gen_dig_type = c->gen_dig_type;
-	e->iam.gen_dig_scheme = c->gen_dig_scheme;
-	strncpy(e->iam.jip_number, c->jip_number, sizeof(e->iam.jip_number));
-	strncpy(e->iam.generic_name, c->generic_name, sizeof(e->iam.generic_name));
-	e->iam.generic_name_typeofname = c->generic_name_typeofname;
-	e->iam.generic_name_avail = c->generic_name_avail;
-	e->iam.generic_name_presentation = c->generic_name_presentation;
-	e->iam.lspi_type = c->lspi_type;
-	e->iam.lspi_scheme = c->lspi_scheme;
-	e->iam.lspi_context = c->lspi_context;
-	strncpy(e->iam.lspi_ident, c->lspi_ident, sizeof(e->iam.lspi_ident));
-	strncpy(e->iam.orig_called_num, c->orig_called_num, sizeof(e->iam.orig_called_num));
-	e->iam.orig_called_nai = c->orig_called_nai;
-	e->iam.orig_called_pres_ind = c->orig_called_pres_ind;
-	e->iam.orig_called_screening_ind = c->orig_called_screening_ind;
-	strncpy(e->iam.redirecting_num, c->redirecting_num, sizeof(e->iam.redirecting_num));
-	e->iam.redirecting_num_nai = c->redirecting_num_nai;
-	e->iam.redirecting_num_presentation_ind = c->redirecting_num_presentation_ind;
-	e->iam.redirecting_num_screening_ind = c->redirecting_num_screening_ind;
-	e->iam.redirect_counter = c->redirect_counter;
-	e->iam.redirect_info = c->redirect_info;
-	e->iam.redirect_info_ind = c->redirect_info_ind;
-	e->iam.redirect_info_orig_reas = c->redirect_info_orig_reas;
-	e->iam.redirect_info_counter = c->redirect_info_counter;
-	e->iam.redirect_info_reas = c->redirect_info_reas;
-	e->iam.calling_party_cat = c->calling_party_cat;
-	e->iam.cug_indicator = c->cug_indicator;
-	e->iam.cug_interlock_code = c->cug_interlock_code;
-	strncpy(e->iam.cug_interlock_ni, c->cug_interlock_ni, sizeof(e->iam.cug_interlock_ni));
 	e->iam.call = c;
 	e->iam.opc = opc;	/* keep OPC information */
-	e->iam.echocontrol_ind = c->echocontrol_ind;
+	if (!(ss7->flags & SS7_EVENT_NOCOPY)) {
+		isup_get_iam(c, &e->iam);
+	}
+	c->cot_check_passed = 0;
 	if (!strchr(c->called_party_num, '#')) {
 		isup_start_timer(ss7, c, ISUP_TIMER_T35);
 	}
@@ -4449,8 +4703,8 @@ int isup_grs(struct ss7 *ss7, struct isup_call *c, int endcic)
 		isup_start_timer(ss7, c, ISUP_TIMER_T23);
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send GRS to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4478,8 +4732,8 @@ int isup_gra(struct ss7 *ss7, struct isup_call *c, int endcic, unsigned char sta
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send GRA to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4516,8 +4770,8 @@ int isup_cgb(struct ss7 *ss7, struct isup_call *c, int endcic, unsigned char sta
 		isup_start_timer(ss7, c, ISUP_TIMER_T19);
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send CGB to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 	return res;
 }
@@ -4554,8 +4808,8 @@ int isup_cgu(struct ss7 *ss7, struct isup_call *c, int endcic, unsigned char sta
 		isup_start_timer(ss7, c, ISUP_TIMER_T21);
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send CGU to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 	return res;
 }
@@ -4581,8 +4835,8 @@ int isup_cgba(struct ss7 *ss7, struct isup_call *c, int endcic, unsigned char st
 	res = isup_send_message(ss7, c, ISUP_CGBA, cicgroup_params);
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send CGBA to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4610,8 +4864,8 @@ int isup_cgua(struct ss7 *ss7, struct isup_call *c, int endcic, unsigned char st
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send CGUA to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4637,8 +4891,8 @@ int isup_iam(struct ss7 *ss7, struct isup_call *c)
 		c->got_sent_msg &= ~ISUP_PENDING_IAM;
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send IAM to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4660,8 +4914,8 @@ int isup_acm(struct ss7 *ss7, struct isup_call *c)
 		isup_stop_timer(ss7, c, ISUP_TIMER_T10);
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send ACM to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4679,8 +4933,8 @@ int isup_frj(struct ss7 *ss7, struct isup_call *c)
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send FRJ to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4698,8 +4952,8 @@ int isup_faa(struct ss7 *ss7, struct isup_call *c)
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send FAA to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4721,8 +4975,8 @@ int isup_far(struct ss7 *ss7, struct isup_call *c)
 			c->got_sent_msg |= ISUP_SENT_FAR;
 		} else {
 			ss7_call_null(ss7, c, 0);
-			isup_free_call(ss7, c);
 			ss7_error(ss7, "Unable to send FAR to DPC: %d\n", c->dpc);
+			isup_free_call(ss7, c);
 		}
 	}
 
@@ -4745,8 +4999,8 @@ int isup_anm(struct ss7 *ss7, struct isup_call *c)
 		isup_stop_timer(ss7, c, ISUP_TIMER_T10);
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send ANM to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4767,8 +5021,8 @@ int isup_con(struct ss7 *ss7, struct isup_call *c)
 
 	if (res < 0) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send CON to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4807,8 +5061,8 @@ int isup_rel(struct ss7 *ss7, struct isup_call *c, int cause)
 		c->got_sent_msg &= ~(ISUP_CALL_PENDING | ISUP_CALL_CONNECTED);
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send REL to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4826,8 +5080,8 @@ int isup_rlc(struct ss7 *ss7, struct isup_call *c)
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send RLC to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4851,8 +5105,8 @@ int isup_inr(struct ss7 *ss7, struct isup_call *c, unsigned char ind0, unsigned
 		isup_start_timer(ss7, c, ISUP_TIMER_T33);
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send INR to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4873,8 +5127,8 @@ int isup_inf(struct ss7 *ss7, struct isup_call *c, unsigned char ind0, unsigned
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send INF to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4893,8 +5147,8 @@ int isup_sus(struct ss7 *ss7, struct isup_call *c, unsigned char indicator)
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send SUS to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4913,8 +5167,8 @@ int isup_res(struct ss7 *ss7, struct isup_call *c, unsigned char indicator)
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send RES to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4948,8 +5202,8 @@ int isup_cpg(struct ss7 *ss7, struct isup_call *c, int event)
 		isup_stop_timer(ss7, c, ISUP_TIMER_T10);
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send CPG to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4971,8 +5225,8 @@ int isup_rsc(struct ss7 *ss7, struct isup_call *c)
 		c->got_sent_msg |= ISUP_SENT_RSC;
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send RSC to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -4994,8 +5248,8 @@ int isup_blo(struct ss7 *ss7, struct isup_call *c)
 		c->got_sent_msg |= ISUP_SENT_BLO;
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send BLO to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -5017,8 +5271,8 @@ int isup_ubl(struct ss7 *ss7, struct isup_call *c)
 		c->got_sent_msg |= ISUP_SENT_UBL;
 	} else {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send UBL to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -5036,8 +5290,8 @@ int isup_bla(struct ss7 *ss7, struct isup_call *c)
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send BLA to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -5089,8 +5343,8 @@ int isup_uba(struct ss7 *ss7, struct isup_call *c)
 
 	if (res == -1) {
 		ss7_call_null(ss7, c, 0);
-		isup_free_call(ss7, c);
 		ss7_error(ss7, "Unable to send UBA to DPC: %d\n", c->dpc);
+		isup_free_call(ss7, c);
 	}
 
 	return res;
@@ -5142,6 +5396,7 @@ static size_t ss7_snprintf(char *buf, size_t buf_used, size_t buf_size, const ch
 void isup_show_calls(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd)
 {
 	int x;
+	unsigned long long mask;
 	char *buf, *tmp_buf;
 	size_t tmp_used, buf_used;
 	size_t buf_size = 4096;	/* This should be bigger than we will ever need. */
@@ -5234,10 +5489,9 @@ void isup_show_calls(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd)
 		}
 		buf_used = ss7_snprintf(buf, buf_used, buf_size, "  %-16s  ", tmp_buf);
 
-		for (x = 0; x < ISUP_MAX_TIMERS; x++) {
-			if (c->timer[x] > -1) {
-				buf_used = ss7_snprintf(buf, buf_used, buf_size, "%s(%li) ", isup_timer2str(x),  ss7->ss7_sched[c->timer[x]].when.tv_sec - time(NULL));
-			}
+		for (mask = c->timer_mask; mask; mask &= mask - 1) {
+			x = __builtin_ctzll(mask);
+			buf_used = ss7_snprintf(buf, buf_used, buf_size, "%s(%i) ", isup_timer2str(x), ss7_schedule_ms_left(ss7, c->timer[x]) / 1000);
 		}
 		cust_printf(fd, "%s\n", buf);
 		c = c->next;
@@ -5247,60 +5501,82 @@ void isup_show_calls(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd)
 	free(tmp_buf);
 }
 
-int ss7_set_isup_timer(struct ss7 *ss7, char *name, int ms)
+static int isup_timer_name2id(const char *name)
 {
 	if (!strcasecmp(name, "t1")) {
-		ss7->isup_timers[ISUP_TIMER_T1] = ms;
+		return ISUP_TIMER_T1;
 	} else if (!strcasecmp(name, "t2")) {
-		ss7->isup_timers[ISUP_TIMER_T2] = ms;
+		return ISUP_TIMER_T2;
 	} else if (!strcasecmp(name, "t5")) {
-		ss7->isup_timers[ISUP_TIMER_T5] = ms;
+		return ISUP_TIMER_T5;
 	} else if (!strcasecmp(name, "t6")) {
-		ss7->isup_timers[ISUP_TIMER_T6] = ms;
+		return ISUP_TIMER_T6;
 	} else if (!strcasecmp(name, "t7")) {
-		ss7->isup_timers[ISUP_TIMER_T7] = ms;
+		return ISUP_TIMER_T7;
 	} else if (!strcasecmp(name, "t8")) {
-		ss7->isup_timers[ISUP_TIMER_T8] = ms;
+		return ISUP_TIMER_T8;
 	} else if (!strcasecmp(name, "t10")) {
-		ss7->isup_timers[ISUP_TIMER_T10] = ms;
+		return ISUP_TIMER_T10;
 	} else if (!strcasecmp(name, "t12")) {
-		ss7->isup_timers[ISUP_TIMER_T12] = ms;
+		return ISUP_TIMER_T12;
 	} else if (!strcasecmp(name, "t13")) {
-		ss7->isup_timers[ISUP_TIMER_T13] = ms;
+		return ISUP_TIMER_T13;
 	} else if (!strcasecmp(name, "t14")) {
-		ss7->isup_timers[ISUP_TIMER_T14] = ms;
+		return ISUP_TIMER_T14;
 	} else if (!strcasecmp(name, "t15")) {
-		ss7->isup_timers[ISUP_TIMER_T15] = ms;
+		return ISUP_TIMER_T15;
 	} else if (!strcasecmp(name, "t16")) {
-		ss7->isup_timers[ISUP_TIMER_T16] = ms;
+		return ISUP_TIMER_T16;
 	} else if (!strcasecmp(name, "t17")) {
-		ss7->isup_timers[ISUP_TIMER_T17] = ms;
+		return ISUP_TIMER_T17;
 	} else if (!strcasecmp(name, "t18")) {
-		ss7->isup_timers[ISUP_TIMER_T18] = ms;
+		return ISUP_TIMER_T18;
 	} else if (!strcasecmp(name, "t19")) {
-		ss7->isup_timers[ISUP_TIMER_T19] = ms;
+		return ISUP_TIMER_T19;
 	} else if (!strcasecmp(name, "t20")) {
-		ss7->isup_timers[ISUP_TIMER_T20] = ms;
+		return ISUP_TIMER_T20;
 	} else if (!strcasecmp(name, "t21")) {
-		ss7->isup_timers[ISUP_TIMER_T21] = ms;
+		return ISUP_TIMER_T21;
 	} else if (!strcasecmp(name, "t22")) {
-		ss7->isup_timers[ISUP_TIMER_T22] = ms;
+		return ISUP_TIMER_T22;
 	} else if (!strcasecmp(name, "t23")) {
-		ss7->isup_timers[ISUP_TIMER_T23] = ms;
+		return ISUP_TIMER_T23;
 	} else if (!strcasecmp(name, "t27")) {
-		ss7->isup_timers[ISUP_TIMER_T27] = ms;
+		return ISUP_TIMER_T27;
 	} else if (!strcasecmp(name, "t33")) {
-		ss7->isup_timers[ISUP_TIMER_T33] = ms;
+		return ISUP_TIMER_T33;
 	} else if (!strcasecmp(name, "t35")) {
-		ss7->isup_timers[ISUP_TIMER_T35] = ms;
-	} else {
+		return ISUP_TIMER_T35;
+	}
+	return 0;
+}
+
+int ss7_set_isup_timer(struct ss7 *ss7, char *name, int ms)
+{
+	int timer = isup_timer_name2id(name);
+
+	if (!timer) {
 		ss7_message(ss7, "Unknown ISUP timer: %s\n", name);
 		return 0;
 	}
+	ss7->isup_timers[timer] = ms;
 	ss7_message(ss7, "ISUP timer %s = %ims\n", name, ms);
 	return 1;
 }
 
+int ss7_set_isup_timer_slack(struct ss7 *ss7, char *name, int ms)
+{
+	int timer = isup_timer_name2id(name);
+
+	if (!timer) {
+		ss7_message(ss7, "Unknown ISUP timer: %s\n", name);
+		return 0;
+	}
+	ss7->timer_slack[SS7_TIMER_ISUP(timer)] = ms;
+	ss7_message(ss7, "ISUP timer %s slack = %ims\n", name, ms);
+	return 1;
+}
+
 static void isup_timer_expiry(void *data)
 {
 	struct isup_timer_param *param = data;
@@ -5316,6 +5592,7 @@ static void isup_timer_expiry(void *data)
 	}
 
 	param->c->timer[param->timer] = -1;
+	param->c->timer_mask &= ~ISUP_TIMER_BIT(param->timer);
 
 	switch (param->timer) {
 		case ISUP_TIMER_T1:
@@ -5347,14 +5624,13 @@ static void isup_timer_expiry(void *data)
 			isup_start_timer(param->ss7, param->c, ISUP_TIMER_T17);
 			break;
 		case ISUP_TIMER_T10:
-			e = ss7_next_empty_event(param->ss7);
+			e = ss7_next_empty_event(param->ss7, ISUP_EVENT_DIGITTIMEOUT);
 			if (!e) {
 				ss7_call_null(param->ss7, param->c, 1);
 				isup_free_call(param->ss7, param->c);
 				break;
 			}
 
-			e->e = ISUP_EVENT_DIGITTIMEOUT;
 			e->digittimeout.cic = param->c->cic;
 			e->digittimeout.call = param->c;
 			e->digittimeout.opc = param->c->dpc;
@@ -5433,38 +5709,30 @@ static void isup_timer_expiry(void *data)
 		default:
 			ss7_message (param->ss7, "timer expired, doing nothing\n");
 	}
-	free(param);
 }
 
 static void isup_stop_timer(struct ss7 *ss7, struct isup_call *c, int timer)
 {
-	struct isup_timer_param *param;
-
 	if (!ss7 || !c) {
 		return;
 	}
 
-	if (c->timer[timer] > -1) {
-		param = ss7->ss7_sched[c->timer[timer]].data;
+	/* Stale ids are rejected by the scheduler */
+	if (c->timer_mask & ISUP_TIMER_BIT(timer)) {
+		c->timer_mask &= ~ISUP_TIMER_BIT(timer);
 		ss7_schedule_del(ss7, &c->timer[timer]);
-		free(param);
-		c->timer[timer] = -1;
 		ss7_debug_msg(ss7, SS7_DEBUG_ISUP, "ISUP timer %s stopped on CIC %i DPC: %i\n", isup_timer2str(timer), c->cic, c->dpc);
 	}
 }
 
 static void isup_stop_all_timers(struct ss7 *ss7, struct isup_call *c)
 {
-	int x;
-
 	if (!ss7 || !c) {
 		return;
 	}
 
-	for (x = 0; x < ISUP_MAX_TIMERS; x++) {
-		if (c->timer[x] > -1) {
-			isup_stop_timer(ss7, c, x);
-		}
+	while (c->timer_mask) {
+		isup_stop_timer(ss7, c, __builtin_ctzll(c->timer_mask));
 	}
 }
 
@@ -5480,45 +5748,35 @@ static int isup_start_timer(struct ss7 *ss7, struct isup_call *c, int timer)
 		return -1;
 	}
 
-	data = calloc(1, sizeof(struct isup_timer_param));
+	isup_stop_timer(ss7, c, timer);
 
+	data = &c->timer_param[timer];
 	data->ss7 = ss7;
 	data->c = c;
 	data->timer = timer;
 
-	if (c->timer[timer] > -1) {
-		isup_stop_timer(ss7, c, timer);
-	}
-	c->timer[timer] = ss7_schedule_event(ss7, ss7->isup_timers[timer], &isup_timer_expiry, data);
+	c->timer[timer] = ss7_schedule_event(ss7, SS7_TIMER_ISUP(timer), ss7->isup_timers[timer], &isup_timer_expiry, data);
 
 	if (c->timer[timer] > -1) {
+		c->timer_mask |= ISUP_TIMER_BIT(timer);
 		ss7_debug_msg(ss7, SS7_DEBUG_ISUP, "ISUP timer %s (%ims) started on CIC %i DPC %i\n", isup_timer2str(timer), ss7->isup_timers[timer], c->cic, c->dpc);
 		return 0;
 	}
 
 	ss7_error(ss7, "Unable to start ISUP timer %s (%ims) on CIC %i DPC %i\n", isup_timer2str(timer), ss7->isup_timers[timer], c->cic, c->dpc);
-	free(data);
 	return -1;
 }
 
 struct isup_call * isup_free_call_if_clear(struct ss7 *ss7, struct isup_call *c)
 {
-	int x;
-
 	if (!ss7 || !c) {
 		return NULL;
 	}
 
-	if (c->got_sent_msg) {
+	if (c->got_sent_msg || c->timer_mask) {
 		return c;
 	}
 
-	for (x = 0; x < ISUP_MAX_TIMERS; x++) {
-		if (c->timer[x] > -1) {
-			return c;
-		}
-	}
-
 	isup_free_call(ss7, c);
 	return NULL;
 }
@@ -221,6 +221,9 @@
 
 
 /* ISUP TIMERS  */
+/* One bit per timer in isup_call->timer_mask, so ISUP_MAX_TIMERS can not exceed 64 */
+#define ISUP_TIMER_BIT(t)	(1ULL << (t))
+
 #define ISUP_TIMER_T1	1
 #define ISUP_TIMER_T2	2
 #define ISUP_TIMER_T5	5
@@ -261,9 +264,19 @@ struct isup_h {
 #define ISUP_MAX_NUM 64
 /* From GR-317 for the generic name filed: 15 + 1 */
 #define ISUP_MAX_NAME 16
+#define ISUP_PARM_MAX_LEN 255	/* most a parameter length byte can say */
 
 struct mtp2;
 
+struct isup_call;
+
+/* Passed to the scheduler for each running ISUP timer, kept in the call */
+struct isup_timer_param {
+	struct ss7 *ss7;
+	struct isup_call *c;
+	int timer;
+};
+
 struct isup_call {
 	char called_party_num[ISUP_MAX_NUM];
 	unsigned char called_nai;
@@ -353,7 +366,9 @@ struct isup_call {
 	unsigned short cug_interlock_code;
 	unsigned char interworking_indicator;
 	unsigned char forward_indicator_pmbits;
-	int timer[ISUP_MAX_TIMERS];
+	long long timer[ISUP_MAX_TIMERS];
+	unsigned long long timer_mask;	/* ISUP_TIMER_BIT() of each running timer */
+	struct isup_timer_param timer_param[ISUP_MAX_TIMERS];
 };
 
 int isup_receive(struct ss7 *ss7, struct mtp2 *sl, struct routing_label *rl, unsigned char *sif, int len);
@@ -362,4 +377,6 @@ int isup_dump(struct ss7 *ss7, struct mtp2 *sl, unsigned char *sif, int len);
 
 void isup_free_all_calls(struct ss7 *ss7);
 
+char * isup_timer2str(int timer);
+
 #endif /* _SS7_ISUP_H */
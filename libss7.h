@@ -191,8 +191,10 @@
 /* FLAGS */
 #define SS7_INR_IF_NO_CALLING		(1 << 0)	/* request calling num, if the remote party didn't send */
 #define SS7_ISDN_ACCESS_INDICATOR	(1 << 1)	/* originating/access indicator */
+#define SS7_EVENT_NOCOPY			(1 << 2)	/* IAM/SAM/ACM/CON/ANM events only carry cic, call, opc and got_sent_msg, use isup_get_*(), not with ss7_set_event_ring() */
 
 struct ss7;
+struct mtp2;
 struct isup_call;
 
 typedef struct {
@@ -463,6 +465,10 @@ typedef union {
 	ss7_event_digittimeout digittimeout;
 } ss7_event;
 
+typedef void (*ss7_event_handler)(struct ss7 *ss7, ss7_event *e, void *data);
+
+typedef void (*ss7_command_fn)(struct ss7 *ss7, void *data);
+
 void ss7_set_message(void (*func)(struct ss7 *ss7, char *message));
 
 void ss7_set_error(void (*func)(struct ss7 *ss7, char *message));
@@ -480,8 +486,35 @@ int ss7_schedule_run(struct ss7 *ss7);
 
 struct timeval *ss7_schedule_next(struct ss7 *ss7);
 
+/* Milliseconds until the next scheduled event, -1 if there is none.
+ * Can be passed straight to poll() as the timeout. */
+int ss7_schedule_next_ms(struct ss7 *ss7);
+
+/* Read the clock once per event loop wakeup.  Timers use that time until the
+ * next ss7_read(), ss7_write(), ss7_schedule_run() or ss7_check_event(s)()
+ * that finds nothing left, whichever comes first. */
+void ss7_clock_tick(struct ss7 *ss7);
+
+/* Get a file descriptor that becomes readable when the next scheduled event
+ * is due, for use with poll()/epoll instead of ss7_schedule_next().  Call
+ * ss7_schedule_run() when it is readable.  The fd is created on the first
+ * call and closed by ss7_destroy().  Linux only, returns -1 elsewhere. */
+int ss7_get_timer_fd(struct ss7 *ss7);
+
+/* Limit the number of timers armed at once, 0 (the default) for no limit */
+void ss7_set_max_timers(struct ss7 *ss7, int max);
+
+/* Message buffers are recycled through a per-instance pool instead of going
+ * back to free().  Allocate prealloc of each size now and keep up to max
+ * spare of each (256 by default, 0 to always free()). */
+int ss7_set_msg_pool(struct ss7 *ss7, int prealloc, int max);
+
 int ss7_add_link(struct ss7 *ss7, int transport, int fd, int slc, unsigned int adjpc);
 
+/* Same as ss7_add_link(), but returns the link for ss7_receive_su() and
+ * ss7_transmit_su(), NULL on failure. */
+struct mtp2 * ss7_add_link_handle(struct ss7 *ss7, int transport, int fd, int slc, unsigned int adjpc);
+
 int ss7_set_network_ind(struct ss7 *ss7, int ni);
 
 int ss7_set_pc(struct ss7 *ss7, unsigned int pc);
@@ -502,12 +535,69 @@ void ss7_clear_flags(struct ss7 *ss7, unsigned int flags);
 
 ss7_event *ss7_check_event(struct ss7 *ss7);
 
+/* Take up to max pending events into ev, returns how many.  They stay valid
+ * until the next call.  Link state events come ahead of pending CIC events. */
+int ss7_check_events(struct ss7 *ss7, ss7_event **ev, int max);
+
+/* Call fn for every event of the given type instead of queueing it for
+ * ss7_check_event(), NULL fn to go back to queueing.  Handlers run from
+ * ss7_read(), ss7_schedule_run() and ss7_check_event(s)() once the library
+ * is done with the message or timer, and may call back into the library
+ * (isup_acm() and friends) but not ss7_check_event(s)().  The event is only
+ * valid until the handler returns. */
+int ss7_set_event_handler(struct ss7 *ss7, int type, ss7_event_handler fn, void *data);
+
+/* Pass events to a call thread through a ring of size slots (0 for the
+ * default), returns an eventfd for ss7_ring_get_event(), -1 on failure */
+int ss7_set_event_ring(struct ss7 *ss7, int size);
+
+/* Call thread: next event from the ring, valid until the next call */
+ss7_event *ss7_ring_get_event(struct ss7 *ss7);
+
+/* Call thread: queue fn to run on the I/O thread, -1 if the ring is full */
+int ss7_ring_command(struct ss7 *ss7, ss7_command_fn fn, void *data);
+
+/* I/O thread: eventfd that says when to call ss7_run_commands() */
+int ss7_get_command_fd(struct ss7 *ss7);
+
+/* I/O thread: run the queued commands, returns how many */
+int ss7_run_commands(struct ss7 *ss7);
+
+/* Limit the number of events waiting for ss7_check_event().  The queue grows
+ * on demand up to this many (4096 by default), 0 for no limit.  Events that
+ * do not fit are dropped and counted in ss7_show_linkset(). */
+void ss7_set_max_events(struct ss7 *ss7, int max);
+
+/* Send SIB and stop accepting MSUs once high events are waiting, until the
+ * backlog is down to low.  Off (0 high) by default: peers running an older
+ * libss7 realign when they receive SIB on a link in service. */
+int ss7_set_event_watermarks(struct ss7 *ss7, int high, int low);
+
 int ss7_start(struct ss7 *ss7);
 
+/* Reads until EAGAIN or ss7_set_rx_budget() SUs if the fd is non-blocking,
+ * returns the number of SUs taken */
 int ss7_read(struct ss7 *ss7, int fd);
 
+/* Most SUs one ss7_read() call takes, 32 by default. */
+int ss7_set_rx_budget(struct ss7 *ss7, int max);
+
+/* Writes queued MSUs back to back, up to ss7_set_tx_budget() of them, if the
+ * fd is non-blocking, one SU otherwise.  Returns the number of SUs written. */
 int ss7_write(struct ss7 *ss7, int fd);
 
+/* Most SUs one ss7_write() call sends, 32 by default. */
+int ss7_set_tx_budget(struct ss7 *ss7, int max);
+
+/* Caller-driven I/O: libss7 makes no read() or write() on the link's fd.
+ * ss7_receive_su() takes one received SU, FCS included, and dispatches
+ * its events.  ss7_transmit_su() puts the next SU to send, FIB/BSN filled
+ * in and two bytes left for the FCS, into buf, which must hold
+ * SS7_MAX_SU_SIZE bytes, and returns its length or -1. */
+#define SS7_MAX_SU_SIZE		280
+int ss7_receive_su(struct ss7 *ss7, struct mtp2 *link, unsigned char *buf, int len);
+int ss7_transmit_su(struct ss7 *ss7, struct mtp2 *link, unsigned char *buf, int len);
+
 void ss7_link_alarm(struct ss7 *ss7, int fd);
 
 void ss7_link_noalarm(struct ss7 *ss7, int fd);
@@ -520,9 +610,16 @@ int ss7_pollflags(struct ss7 *ss7, int fd);
 
 int ss7_set_mtp3_timer(struct ss7 *ss7, char *name, int ms);
 
+/* Let the named timer expire up to ms later than its nominal value, so that
+ * timers of the same kind armed close together share one wakeup.  The
+ * default slack is 0.  MTP2 timers never get slack. */
+int ss7_set_mtp3_timer_slack(struct ss7 *ss7, char *name, int ms);
+
 /* ISUP call related message functions */
 int ss7_set_isup_timer(struct ss7 *ss7, char *name, int ms);
 
+int ss7_set_isup_timer_slack(struct ss7 *ss7, char *name, int ms);
+
 struct isup_call * isup_free_call_if_clear(struct ss7 *ss7, struct isup_call *c);
 
 int isup_start_digittimeout(struct ss7 *ss7, struct isup_call *c);
@@ -664,12 +761,67 @@ void isup_set_calling_party_category(struct isup_call *c, unsigned int category)
 
 /* End of call related sets */
 
+/* Call related gets, for SS7_EVENT_NOCOPY events.  The out parameters may be NULL. */
+void isup_get_iam(const struct isup_call *c, ss7_event_iam *iam);
+
+const char *isup_get_called(const struct isup_call *c, unsigned char *called_nai);
+
+const char *isup_get_calling(const struct isup_call *c, unsigned char *calling_nai, unsigned char *presentation_ind, unsigned char *screening_ind);
+
+const char *isup_get_connected(const struct isup_call *c, unsigned char *connected_nai, unsigned char *connected_presentation_ind, unsigned char *connected_screening_ind);
+
+const char *isup_get_redirecting_number(const struct isup_call *c, unsigned char *redirecting_num_nai, unsigned char *redirecting_num_presentation_ind, unsigned char *redirecting_num_screening_ind);
+
+int isup_get_redirection_info(const struct isup_call *c, unsigned char *redirect_info_ind, unsigned char *redirect_info_orig_reas, unsigned char *redirect_info_counter, unsigned char *redirect_info_reas);
+
+unsigned char isup_get_redirect_counter(const struct isup_call *c);
+
+const char *isup_get_orig_called_num(const struct isup_call *c, unsigned char *orig_called_nai, unsigned char *orig_called_pres_ind, unsigned char *orig_called_screening_ind);
+
+int isup_get_tmr(const struct isup_call *c);
+
+const char *isup_get_charge(const struct isup_call *c, unsigned char *charge_nai, unsigned char *charge_num_plan);
+
+int isup_get_oli(const struct isup_call *c);
+
+const char *isup_get_gen_address(const struct isup_call *c, unsigned char *gen_add_nai, unsigned char *gen_pres_ind, unsigned char *gen_num_plan, unsigned char *gen_add_type);
+
+const char *isup_get_gen_digits(const struct isup_call *c, unsigned char *gen_dig_type, unsigned char *gen_dig_scheme);
+
+const char *isup_get_cug(const struct isup_call *c, unsigned char *cug_indicator, unsigned short *cug_interlock_code);
+
+unsigned char isup_get_echocontrol(const struct isup_call *c);
+
+const char *isup_get_generic_name(const struct isup_call *c, unsigned int *typeofname, unsigned int *availability, unsigned int *presentation);
+
+const char *isup_get_jip_digits(const struct isup_call *c);
+
+const char *isup_get_lspi(const struct isup_call *c, unsigned char *lspi_type, unsigned char *lspi_scheme, unsigned char *lspi_context);
+
+void isup_get_callref(const struct isup_call *c, unsigned int *call_ref_ident, unsigned int *call_ref_pc);
+
+unsigned int isup_get_calling_party_category(const struct isup_call *c);
+
+unsigned char isup_get_called_party_status(const struct isup_call *c);
+
+void isup_get_cot(const struct isup_call *c, int *cot_check_required, int *cot_performed_on_previous_cic, int *cot_check_passed);
+
+/* End of call related gets */
+
 typedef void (*ss7_printf_cb)(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 
 void isup_show_calls(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd);
 
 void ss7_show_linkset(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd);
 
+/* Per timer counts of starts, cancels and expiries, and how late expiries ran.
+ * Disabled by default, enabling it allocates the counters. */
+void ss7_set_timer_stats(struct ss7 *ss7, int enable);
+
+void ss7_reset_timer_stats(struct ss7 *ss7);
+
+void ss7_show_timer_stats(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd);
+
 /* net mng */
 const char * mtp3_net_mng(struct ss7 *ss7, unsigned int slc, const char *cmd, unsigned int param);
 
@@ -41,16 +41,13 @@
 #define mtp_error ss7_error
 #define mtp_message ss7_message
 
-int len_buf(struct ss7_msg *buf)
-{
-	int res = 0;
-	struct ss7_msg *cur = buf;
+/* FSN arithmetic, modulo 128 */
+#define fsn_diff(a, b)	(((a) - (b)) & (MTP2_FSN_MOD - 1))
+#define fsn_next(a)		(((a) + 1) & (MTP2_FSN_MOD - 1))
 
-	while (cur) {
-		res++;
-		cur = cur->next;
-	}
-	return res;
+int mtp2_txbuf_len(struct mtp2 *link)
+{
+	return fsn_diff(link->curfsn, link->lastbsnrxd);
 }
 
 static inline char * linkstate2str(int linkstate)
@@ -91,6 +88,24 @@ char *linkstate2strext(int linkstate)
 	return linkstate2str(linkstate);
 }
 
+char *mtp2_timer2str(int timer)
+{
+	switch (timer) {
+		case MTP2_TIMER_T1:
+			return "T1";
+		case MTP2_TIMER_T2:
+			return "T2";
+		case MTP2_TIMER_T3:
+			return "T3";
+		case MTP2_TIMER_T4:
+			return "T4";
+		case MTP2_TIMER_T7:
+			return "T7";
+		default:
+			return "Unknown";
+	}
+}
+
 static inline void init_mtp2_header(struct mtp2 *link, struct mtp_su_head *h, int new, int nack)
 {
 	if (new) {
@@ -117,29 +132,35 @@ static inline int lssu_type(struct mtp_su_head *h)
 
 void flush_bufs(struct mtp2 *link)
 {
-	struct ss7_msg *list, *cur;
-
-	list = link->tx_buf;
-
-	link->tx_buf = NULL;
+	int i;
 
-	while (list) {
-		cur = list;
-		list = list->next;
-		free(cur);
+	for (i = 0; i < MTP2_FSN_MOD; i++) {
+		if (link->tx_buf[i]) {
+			ss7_msg_free(link->master, link->tx_buf[i]);
+			link->tx_buf[i] = NULL;
+		}
 	}
+	link->lastbsnrxd = link->curfsn;
+
+	ss7_msgq_flush(link->master, &link->tx_q);
 
-	list = link->tx_q;
+	link->retransmit_pos = -1;
+}
 
-	link->tx_q = NULL;
+void mtp2_retrieve_txbuf(struct mtp2 *link, struct ss7_msgq *q)
+{
+	struct ss7_msg *m;
 
-	while (list) {
-		cur = list;
-		list = list->next;
-		free(cur);
+	while (link->lastbsnrxd != link->curfsn) {
+		link->lastbsnrxd = fsn_next(link->lastbsnrxd);
+		m = link->tx_buf[link->lastbsnrxd];
+		link->tx_buf[link->lastbsnrxd] = NULL;
+		if (m) {
+			ss7_msgq_add(q, m);
+		}
 	}
 
-	link->retransmit_pos = NULL;
+	link->retransmit_pos = -1;
 }
 
 static void reset_mtp(struct mtp2 *link)
@@ -148,11 +169,12 @@ static void reset_mtp(struct mtp2 *link)
 	link->curfib = 1;
 	link->curbib = 1;
 #if 0
-	ss7_message(link->master, "Lastfsn: %i txbuflen: %i SLC: %i ADJPC: %i\n", link->lastfsnacked, len_buf(link->tx_buf), link->slc, link->dpc);
+	ss7_message(link->master, "Lastfsn: %i txbuflen: %i SLC: %i ADJPC: %i\n", link->lastfsnacked, mtp2_txbuf_len(link), link->slc, link->dpc);
 #endif
 	link->lastfsnacked = 127;
 	link->retransmissioncount = 0;
 	link->flags |= MTP2_FLAG_WRITE;
+	link->flags &= ~(MTP2_FLAG_BUSY | MTP2_FLAG_RXDROP);
 
 	flush_bufs(link);
 }
@@ -167,18 +189,7 @@ static void mtp2_request_retransmission(struct mtp2 *link)
 
 static int mtp2_queue_su(struct mtp2 *link, struct ss7_msg *m)
 {
-	struct ss7_msg *cur;
-
-	if (!link->tx_q) {
-		link->tx_q = m;
-		m->next = NULL;
-		return 0;
-	}
-
-	for (cur = link->tx_q; cur->next; cur = cur->next);
-
-	cur->next = m;
-	m->next = NULL;
+	ss7_msgq_add(&link->tx_q, m);
 
 	return 0;
 }
@@ -228,49 +239,34 @@ static void make_fisu(struct mtp2 *link, unsigned char *buf, unsigned int *size,
 
 static void add_txbuf(struct mtp2 *link, struct ss7_msg *m)
 {
-	m->next = link->tx_buf;
-	link->tx_buf = m;
+	link->tx_buf[link->curfsn] = m;
 #if 0
-	mtp_message(link->master, "Txbuf contains %d items\n", len_buf(link->tx_buf));
+	mtp_message(link->master, "Txbuf contains %d items\n", mtp2_txbuf_len(link));
 #endif
 }
 
 static void update_retransmit_pos(struct mtp2 *link)
 {
-	struct ss7_msg *cur, *prev = NULL;
-	/* Our txbuf is in reversed order from the order we need to retransmit in */
-
-	cur = link->tx_buf;
-
-	while (cur) {
-		if (cur == link->retransmit_pos)
-			break;
-		prev = cur;
-		cur = cur->next;
+	if (link->retransmit_pos == link->curfsn) {
+		link->retransmit_pos = -1;
+	} else {
+		link->retransmit_pos = fsn_next(link->retransmit_pos);
 	}
-
-	link->retransmit_pos = prev;
-	
 }
 
 static void mtp2_retransmit(struct mtp2 *link)
 {
-	struct ss7_msg *m;
-
 	link->flags |= MTP2_FLAG_WRITE;
 	/* Have to invert the current fib */
 	link->curfib = !link->curfib;
 
-	m = link->tx_buf;
-	if (!m) {
+	if (!mtp2_txbuf_len(link)) {
 		ss7_error(link->master, "Huh!? Asked to retransmit but we don't have anything in the tx buffer\n");
 		return;
 	}
 
-	while (m->next)
-		m = m->next;
-
-	link->retransmit_pos = m;
+	/* The oldest unacked MSU goes first */
+	link->retransmit_pos = fsn_next(link->lastbsnrxd);
 }
 
 static void t7_expiry(void *data)
@@ -282,27 +278,34 @@ static void t7_expiry(void *data)
 	mtp2_setstate(link, MTP_IDLE);
 }
 
-int mtp2_transmit(struct mtp2 *link)
+/* MSUs waiting that the window lets us send now */
+int mtp2_tx_pending(struct mtp2 *link)
+{
+	return link->retransmit_pos > -1 ||
+		(link->tx_q.head && mtp2_txbuf_len(link) < MTP2_MAX_OUTSTANDING);
+}
+
+/* Pick the next SU and update the link as if it went out.  Returns the frame,
+ * *size has the FCS included. */
+static unsigned char * mtp2_next_su(struct mtp2 *link, unsigned char *buf, unsigned int *size, struct ss7_msg **mp, int *retransmit)
 {
-	int res = 0;
 	unsigned char *h;
-	unsigned char buf[64];
-	unsigned int size;
 	struct ss7_msg *m = NULL;
-	int retransmit = 0;
 
-	if (link->retransmit_pos) {
+	*retransmit = 0;
+
+	if (link->retransmit_pos > -1) {
 		struct mtp_su_head *h1;
-		m = link->retransmit_pos;
-		retransmit = 1;
+		m = link->tx_buf[link->retransmit_pos];
+		*retransmit = 1;
 
 		if (!m) {
 			ss7_error(link->master, "Huh, requested to retransmit, but nothing in retransmit buffer?!!\n");
-			return -1;
+			return NULL;
 		}
 
 		h = m->buf;
-		size = m->size;
+		*size = m->size + MTP2_FCS_SIZE;
 
 		h1 = (struct mtp_su_head *)h;
 		/* Update the FIB and BSN since they aren't the same */
@@ -310,55 +313,107 @@ int mtp2_transmit(struct mtp2 *link)
 		h1->bsn = link->lastfsnacked;
 
 	} else {
-		if (link->tx_q) {
-			m = link->tx_q;
+		m = link->tx_q.head;
+
+		if (m && mtp2_txbuf_len(link) >= MTP2_MAX_OUTSTANDING) {
+			/* Window full, FISUs until the far end acks some */
+			m = NULL;
 		}
 
 		if (m) {
 			h = m->buf;
-			init_mtp2_header(link, (struct mtp_su_head *) h, 1, 0);	/* in changeover we may manipulate the buffers!!! */
-			size = m->size;
+			init_mtp2_header(link, (struct mtp_su_head *) h, 1, 0);
+			*size = m->size + MTP2_FCS_SIZE;
 
 			/* Advance to next MSU to be transmitted */
-			link->tx_q = m->next;
+			ss7_msgq_pop(&link->tx_q);
 			/* Add it to the tx'd message queue (MSUs that haven't been acknowledged) */
 			add_txbuf(link, m);
 			if (link->t7 == -1) {
-				link->t7 = ss7_schedule_event(link->master, link->timers.t7, t7_expiry, link);
+				link->t7 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T7), link->timers.t7, t7_expiry, link);
 			}
 		} else {
-			size = sizeof(buf);
+			*size = 64;
 			if (link->autotxsutype == FISU) {
-				make_fisu(link, buf, &size, 0);
+				make_fisu(link, buf, size, 0);
 			} else {
-				make_lssu(link, buf, &size, link->autotxsutype);
+				make_lssu(link, buf, size, link->autotxsutype);
 			}
 			h = buf;
 		}
 	}
 
-	res = write(link->fd, h, size);	/* Add 2 for FCS */
+	*mp = m;
+	return h;
+}
 
-	if (res > 0) {
-		mtp2_dump(link, '>', h, size - 2);
-		if (retransmit) {
-			/* Update our retransmit positon since it transmitted */
-			update_retransmit_pos(link);
-		}
+static void mtp2_su_sent(struct mtp2 *link, unsigned char *h, unsigned int size, int retransmit, int msu)
+{
+	mtp2_dump(link, '>', h, size - MTP2_FCS_SIZE);
+	if (retransmit) {
+		/* Update our retransmit positon since it transmitted */
+		update_retransmit_pos(link);
+	}
 
-		if (h == buf) {	/* We just sent a non MSU */
-			link->flags &= ~MTP2_FLAG_WRITE;
-		}
+	if (!msu) {	/* We just sent a non MSU */
+		link->flags &= ~MTP2_FLAG_WRITE;
+	}
+}
+
+int mtp2_transmit(struct mtp2 *link)
+{
+	int res = 0;
+	unsigned char *h;
+	unsigned char buf[64];
+	unsigned int size;
+	struct ss7_msg *m = NULL;
+	int retransmit = 0;
+
+	h = mtp2_next_su(link, buf, &size, &m, &retransmit);
+	if (!h) {
+		return -1;
+	}
+
+	res = write(link->fd, h, size);	/* FCS included */
+
+	if (res > 0) {
+		mtp2_su_sent(link, h, size, retransmit, h != buf);
 	} else {
-		ss7_error(link->master, "mtp2_transmit: write returned %d, errno=%d\n", res, errno);
+		if (res == 0 || errno != EAGAIN) {
+			ss7_error(link->master, "mtp2_transmit: write returned %d, errno=%d\n", res, errno);
+		}
 		if (!retransmit && m) {	/* We need to retransmit, but on retransmit, we'll just try again later */
-			link->retransmit_pos = link->tx_buf;
+			link->retransmit_pos = link->curfsn;
 		}
 	}
 
 	return res;
 }
 
+/* Same as mtp2_transmit(), but the SU is copied into out for the caller to send */
+int mtp2_transmit_buf(struct mtp2 *link, unsigned char *out, int len)
+{
+	unsigned char *h;
+	unsigned char buf[64];
+	unsigned int size;
+	struct ss7_msg *m = NULL;
+	int retransmit = 0;
+
+	if (len < SS7_MAX_SU_SIZE) {
+		return -1;
+	}
+
+	h = mtp2_next_su(link, buf, &size, &m, &retransmit);
+	if (!h) {
+		return -1;
+	}
+
+	memcpy(out, h, size);
+	mtp2_su_sent(link, h, size, retransmit, h != buf);
+
+	return size;
+}
+
 int mtp2_msu(struct mtp2 *link, struct ss7_msg *m)
 {
 	int len = m->size - MTP2_SIZE;
@@ -374,7 +429,6 @@ int mtp2_msu(struct mtp2 *link, struct ss7_msg *m)
 		h->li = len;
 	}
 
-	m->size += 2; /* For CRC */
 	mtp2_queue_su(link, m);
 	/* Just in case */
 	m->next = NULL;
@@ -396,55 +450,95 @@ static int mtp2_fisu(struct mtp2 *link, int nack)
 	return 0;
 }
 
-void update_txbuf(struct mtp2 *link, struct ss7_msg **buf, unsigned char upto)
+/* Start or stop sending SIB in place of FISUs.  MSUs dropped meanwhile are
+ * asked for again when it stops. */
+void mtp2_set_busy(struct mtp2 *link, int busy)
 {
-	struct mtp_su_head *h;
-	struct ss7_msg *prev = NULL, *cur;
-	struct ss7_msg *frlist = NULL;
-	/* Make a list, frlist that will be the SUs to free */
+	if (busy) {
+		if ((link->state == MTP_INSERVICE) && !(link->flags & MTP2_FLAG_BUSY)) {
+			link->flags |= MTP2_FLAG_BUSY;
+			mtp2_lssu(link, LSSU_SIB);
+		}
+		return;
+	}
 
-	/* Empty list */
-	if (!*buf) {
+	if (!(link->flags & MTP2_FLAG_BUSY)) {
 		return;
 	}
 
-	cur = *buf;
+	if ((link->state == MTP_INSERVICE) && (link->autotxsutype == LSSU_SIB)) {
+		mtp2_fisu(link, 0);
+		/* Unless a retransmission request is already waiting for the far end */
+		if ((link->flags & MTP2_FLAG_RXDROP) && (link->lastfibrxd == link->curbib)) {
+			mtp2_request_retransmission(link);
+		}
+	}
+	link->flags &= ~(MTP2_FLAG_BUSY | MTP2_FLAG_RXDROP);
+}
 
-	while (cur) {
-		h = (struct mtp_su_head *)cur->buf;
-		if (h->fsn == upto) {
-			frlist = cur;
-			if (!prev) {	/* Head of list */
-				*buf = NULL;
-			} else {
-				prev->next = NULL;
-			}
-			frlist = cur;
-			break;
+static void mtp2_ack(struct mtp2 *link, unsigned char bsn)
+{
+	int outstanding = mtp2_txbuf_len(link);
+	int n = fsn_diff(bsn, link->lastbsnrxd);
+
+	/* Nothing new acked, or a BSN we haven't sent yet */
+	if (!n || n > outstanding) {
+		return;
+	}
+
+	while (n--) {
+		link->lastbsnrxd = fsn_next(link->lastbsnrxd);
+		ss7_msg_free(link->master, link->tx_buf[link->lastbsnrxd]);
+		link->tx_buf[link->lastbsnrxd] = NULL;
+		outstanding--;
+	}
+
+	/* Don't retransmit what has just been acked */
+	if (link->retransmit_pos > -1) {
+		n = fsn_diff(link->retransmit_pos, link->lastbsnrxd);
+		if (!n || n > outstanding) {
+			link->retransmit_pos = outstanding ? fsn_next(link->lastbsnrxd) : -1;
 		}
-		prev = cur;
-		cur = cur->next;
 	}
 
-	if (link && frlist && link->t7 > -1) {
-		ss7_schedule_del(link->master, &link->t7);
-		if (link->tx_buf) {
-			link->t7 = ss7_schedule_event(link->master, link->timers.t7, &t7_expiry, link);
+	if (link->tx_q.head) {
+		link->flags |= MTP2_FLAG_WRITE;
+	}
+
+	if (link->t7 > -1) {
+		/* Acks come far more often than T7 expires, so just move its deadline */
+		if (!outstanding) {
+			ss7_schedule_del(link->master, &link->t7);
+		} else if (ss7_schedule_refresh(link->master, link->t7, link->timers.t7)) {
+			link->t7 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T7), link->timers.t7, &t7_expiry, link);
 		}
 	}
+}
 
-	while (frlist) {
-		cur = frlist;
-		frlist = frlist->next;
-		free(cur);
+void update_txbuf(struct ss7 *ss7, struct ss7_msgq *buf, unsigned char upto)
+{
+	struct mtp_su_head *h;
+	int n;
+
+	if (!buf->head) {
+		return;
 	}
 
-	return;
+	/* buf is in FSN order, drop everything up to and including upto */
+	h = (struct mtp_su_head *)buf->head->buf;
+	n = fsn_diff(upto, h->fsn) + 1;
+	if (n > buf->len) {
+		return;
+	}
+
+	while (n--) {
+		ss7_msg_free(ss7, ss7_msgq_pop(buf));
+	}
 }
 
 static int fisu_rx(struct mtp2 *link, struct mtp_su_head *h, int len)
 {
-	if ((link->state == MTP_INSERVICE) && (h->fsn != link->lastfsnacked) && (h->fib == link->curbib)) {
+	if ((link->state == MTP_INSERVICE) && !(link->flags & MTP2_FLAG_RXDROP) && (h->fsn != link->lastfsnacked) && (h->fib == link->curbib)) {
 		mtp_message(link->master, "Received out of sequence FISU w/ fsn of %d, lastfsnacked = %d, requesting retransmission\n", h->fsn, link->lastfsnacked);
 		mtp2_request_retransmission(link);
 	}
@@ -530,7 +624,7 @@ int mtp2_setstate(struct mtp2 *link, int newstate)
 		case MTP_ALARM:
 			return 0;
 		case MTP_IDLE:
-			link->t2 = ss7_schedule_event(link->master, link->timers.t2, t2_expiry, link);
+			link->t2 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T2), link->timers.t2, t2_expiry, link);
 			if (mtp2_lssu(link, LSSU_SIO)) {
 				mtp_error(link->master, "Unable to transmit initial LSSU\n");
 				return -1;
@@ -545,9 +639,9 @@ int mtp2_setstate(struct mtp2 *link, int newstate)
 				case MTP_ALIGNED:
 				case MTP_PROVING:
 					if (newstate == MTP_ALIGNED)
-						link->t3 = ss7_schedule_event(link->master, link->timers.t3, t3_expiry, link);
+						link->t3 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T3), link->timers.t3, t3_expiry, link);
 					else
-						link->t4 = ss7_schedule_event(link->master, link->provingperiod, t4_expiry, link);
+						link->t4 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T4), link->provingperiod, t4_expiry, link);
 					if (link->emergency) {
 						if (mtp2_lssu(link, LSSU_SIE)) {
 							mtp_error(link->master, "Couldn't tx LSSU_SIE\n");
@@ -570,7 +664,7 @@ int mtp2_setstate(struct mtp2 *link, int newstate)
 				case MTP_IDLE:
 					return to_idle(link);
 				case MTP_PROVING:
-					link->t4 = ss7_schedule_event(link->master, link->provingperiod, t4_expiry, link);
+					link->t4 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T4), link->provingperiod, t4_expiry, link);
 			}
 			link->state = newstate;
 			return 0;
@@ -581,7 +675,7 @@ int mtp2_setstate(struct mtp2 *link, int newstate)
 				case MTP_IDLE:
 					return to_idle(link);
 				case MTP_PROVING:
-					link->t4 = ss7_schedule_event(link->master, link->provingperiod, t4_expiry, link);
+					link->t4 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T4), link->provingperiod, t4_expiry, link);
 					break;
 				case MTP_ALIGNED:
 					if (link->emergency) {
@@ -597,7 +691,7 @@ int mtp2_setstate(struct mtp2 *link, int newstate)
 					}
 					break;
 				case MTP_ALIGNEDREADY:
-					link->t1 = ss7_schedule_event(link->master, link->timers.t1, t1_expiry, link);
+					link->t1 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T1), link->timers.t1, t1_expiry, link);
 					if (mtp2_fisu(link, 0)) {
 						mtp_error(link->master, "Could not transmit FISU\n");
 						return -1;
@@ -613,7 +707,7 @@ int mtp2_setstate(struct mtp2 *link, int newstate)
 				case MTP_IDLE:
 					return to_idle(link);
 				case MTP_ALIGNEDREADY:
-					link->t1 = ss7_schedule_event(link->master, link->timers.t1, t1_expiry, link);
+					link->t1 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T1), link->timers.t1, t1_expiry, link);
 					if (mtp2_fisu(link, 0)) {
 						mtp_error(link->master, "Could not transmit FISU\n");
 						return -1;
@@ -621,11 +715,10 @@ int mtp2_setstate(struct mtp2 *link, int newstate)
 					break;
 				case MTP_INSERVICE:
 					ss7_schedule_del(link->master, &link->t1);
-					e = ss7_next_empty_event(link->master);
+					e = ss7_next_empty_event(link->master, MTP2_LINK_UP);
 					if (!e) {
 						return -1;
 					}
-					e->link.e = MTP2_LINK_UP;
 					e->link.link = link;
 					break;
 				default:
@@ -636,11 +729,10 @@ int mtp2_setstate(struct mtp2 *link, int newstate)
 			return 0;
 		case MTP_INSERVICE:
 			if (newstate != MTP_INSERVICE) {
-				e = ss7_next_empty_event(link->master);
+				e = ss7_next_empty_event(link->master, MTP2_LINK_DOWN);
 				if (!e) {
 					return -1;
 				}
-				e->link.e = MTP2_LINK_DOWN;
 				e->link.link = link;
 				return to_idle(link);
 			}
@@ -658,6 +750,15 @@ static int lssu_rx(struct mtp2 *link, struct mtp_su_head *h, int len)
 		mtp_error(link->master, "Received LSSU with length %d longer than expected\n", len);
 	}
 
+	/* Far end is busy (Q.703 9.3), it still acks, so just keep T7 from failing the link */
+	if ((lssutype == LSSU_SIB) && (link->state == MTP_INSERVICE)) {
+		link->lastsurxd = lssutype;
+		if ((link->t7 > -1) && ss7_schedule_refresh(link->master, link->t7, link->timers.t7)) {
+			link->t7 = ss7_schedule_event(link->master, SS7_TIMER_MTP2(MTP2_TIMER_T7), link->timers.t7, &t7_expiry, link);
+		}
+		return 0;
+	}
+
 	if (link->lastsurxd == lssutype) {
 		return 0;
 	} else {
@@ -752,11 +853,22 @@ static int msu_rx(struct mtp2 *link, struct mtp_su_head *h, int len)
 	}
 
 	if (h->fsn != ((link->lastfsnacked+1) % 128)) {
+		if (link->flags & MTP2_FLAG_RXDROP) {
+			/* Follows one we dropped while busy, asked for again once we aren't */
+			return 0;
+		}
 		mtp_message(link->master, "Received out of sequence MSU w/ fsn of %d, lastfsnacked = %d, requesting retransmission\n", h->fsn, link->lastfsnacked);
 		mtp2_request_retransmission(link);
 		return 0;
 	}
 
+	/* Too many events pending, leave it unacknowledged until we're not busy */
+	if (link->master->ev_throttled) {
+		mtp2_set_busy(link, 1);
+		link->flags |= MTP2_FLAG_RXDROP;
+		return 0;
+	}
+
 	/* Ok, it's a valid MSU now and we can accept it */
 	link->lastfsnacked = h->fsn;
 	/* Set write flag since we need to update the FISUs with our new BSN */
@@ -934,12 +1046,13 @@ int mtp2_receive(struct mtp2 *link, unsigned char *buf, int len)
 
 	mtp2_dump(link, '<', buf, len);
 
-	update_txbuf(link, &link->tx_buf, h->bsn);
+	link->lastfibrxd = h->fib;
+	mtp2_ack(link, h->bsn);
 
 	/* Check for retransmission request */
 	if ((link->state == MTP_INSERVICE) &&  (h->bib != link->curfib)) {
 		/* Negative ack */
-		ss7_message(link->master, "Got retransmission request sequence numbers greater than %d. Retransmitting %d message(s).\n", h->bsn, len_buf(link->tx_buf));
+		ss7_message(link->master, "Got retransmission request sequence numbers greater than %d. Retransmitting %d message(s).\n", h->bsn, mtp2_txbuf_len(link));
 		mtp2_retransmit(link);
 	}
 
@@ -41,6 +41,11 @@
 
 #define MTP2_SU_HEAD_SIZE	3
 #define MTP2_SIZE			MTP2_SU_HEAD_SIZE
+#define MTP2_FCS_SIZE		2
+
+/* FSNs are modulo 128, at most 127 MSUs may be outstanding (Q.703) */
+#define MTP2_FSN_MOD			128
+#define MTP2_MAX_OUTSTANDING	127
 
 /* MTP2 Timers */
 /* For ITU 64kbps links */
@@ -59,6 +64,13 @@
 #define ANSI_TIMER_T4_EMERGENCY	600
 #define ANSI_TIMER_T7			1250
 
+/* MTP2 timer ids, for the scheduler statistics */
+#define MTP2_TIMER_T1	1
+#define MTP2_TIMER_T2	2
+#define MTP2_TIMER_T3	3
+#define MTP2_TIMER_T4	4
+#define MTP2_TIMER_T7	7
+
 /* Bottom 3 bits in LSSU status field */
 #define LSSU_SIO	0	/* Out of alignment */
 #define LSSU_SIN	1	/* Normal alignament */
@@ -113,27 +125,29 @@ struct mtp2 {
 	int changeover;
 	unsigned int got_sent_netmsg;
 
-	struct ss7_msg *co_buf;
-	struct ss7_msg *cb_buf;
+	struct ss7_msgq co_buf;
+	struct ss7_msgq cb_buf;
 
 	unsigned char curfsn:7;
 	unsigned char curfib:1;
 	unsigned char lastfsnacked:7;
 	unsigned char co_lastfsnacked:7;	/* store here before reset_mtp clear */
+	unsigned char lastbsnrxd:7;		/* last of our FSNs acked by the far end */
 
 	unsigned char curbib:1;
+	unsigned char lastfibrxd:1;	/* FIB of the last SU received */
 	int fd;
 	int flags;
 
-	int mtp3_timer[MTP3_MAX_TIMERS];
+	long long mtp3_timer[MTP3_MAX_TIMERS];
 	int q707_t1_failed;
 
 	/* Timers */
-	int t1;
-	int t2;
-	int t3;
-	int t4;
-	int t7;
+	long long t1;
+	long long t2;
+	long long t3;
+	long long t4;
+	long long t7;
 	struct mtp2_timers timers;
 
 	int slc;
@@ -150,11 +164,11 @@ struct mtp2 {
 	/* Line related stats */
 	unsigned int retransmissioncount;
 
-	struct ss7_msg *tx_buf;
-	struct ss7_msg *tx_q;
-	struct ss7_msg *retransmit_pos;
-	struct ss7_msg *co_tx_buf;	/* store here before reset_mtp flush it */
-	struct ss7_msg *co_tx_q;
+	struct ss7_msg *tx_buf[MTP2_FSN_MOD];	/* sent, not yet acked, indexed by FSN */
+	struct ss7_msgq tx_q;
+	int retransmit_pos;		/* FSN to retransmit next, -1 if none */
+	struct ss7_msgq co_tx_buf;	/* store here before reset_mtp flush it */
+	struct ss7_msgq co_tx_q;
 	struct adjacent_sp *adj_sp;
 	unsigned char cb_seq;
 	struct ss7 *master;
@@ -163,6 +177,10 @@ struct mtp2 {
 /* Flags for the struct mtp2 flags parameter */
 #define MTP2_FLAG_DAHDIMTP2	(1 << 0)
 #define MTP2_FLAG_WRITE		(1 << 1)
+#define MTP2_FLAG_NONBLOCK	(1 << 2)	/* fd was non-blocking when added, ss7_read() and ss7_write() may loop */
+#define MTP2_FLAG_SOCKET	(1 << 3)	/* fd is a socket, ss7_read() uses recvmmsg() */
+#define MTP2_FLAG_BUSY		(1 << 4)	/* sending SIB, MSUs are not accepted */
+#define MTP2_FLAG_RXDROP	(1 << 5)	/* MSUs were dropped while busy */
 
 /* Initialize MTP link */
 int mtp2_start(struct mtp2 *link, int emergency);
@@ -172,12 +190,17 @@ int mtp2_noalarm(struct mtp2 *link);
 int mtp2_setstate(struct mtp2 *link, int state);
 struct mtp2 * mtp2_new(int fd, unsigned int switchtype);
 int mtp2_transmit(struct mtp2 *link);
+int mtp2_transmit_buf(struct mtp2 *link, unsigned char *out, int len);
+int mtp2_tx_pending(struct mtp2 *link);
+void mtp2_set_busy(struct mtp2 *link, int busy);
 int mtp2_receive(struct mtp2 *link, unsigned char *buf, int len);
 int mtp2_msu(struct mtp2 *link, struct ss7_msg *m);
 void mtp2_dump(struct mtp2 *link, char prefix, unsigned char *buf, int len);
 char *linkstate2strext(int linkstate);
-void update_txbuf(struct mtp2 *link, struct ss7_msg **buf, unsigned char upto);
-int len_buf(struct ss7_msg *buf);
+char *mtp2_timer2str(int timer);
+void update_txbuf(struct ss7 *ss7, struct ss7_msgq *buf, unsigned char upto);
+int mtp2_txbuf_len(struct mtp2 *link);
+void mtp2_retrieve_txbuf(struct mtp2 *link, struct ss7_msgq *q);
 void flush_bufs(struct mtp2 *link);
 
 #endif /* _SS7_MTP_H */
@@ -172,7 +172,7 @@ static inline unsigned char get_h1(unsigned char *byte)
 	return (((*byte) & 0xf0) >> 4);
 }
 
-static inline int link_available(struct ss7 *ss7, int linkid, struct ss7_msg ***buffer, struct routing_label rl)
+static inline int link_available(struct ss7 *ss7, int linkid, struct ss7_msgq **buffer, struct routing_label rl)
 {
 	if ((ss7->mtp2_linkstate[linkid] == MTP2_LINKSTATE_UP &&
 			ss7->links[linkid]->adj_sp->state == MTP3_UP &&
@@ -218,7 +218,7 @@ static inline int link_available(struct ss7 *ss7, int linkid, struct ss7_msg ***
 	}
 }
 
-static inline struct mtp2 * rl_to_link(struct ss7 *ss7, struct routing_label rl, struct ss7_msg ***buffer)
+static inline struct mtp2 * rl_to_link(struct ss7 *ss7, struct routing_label rl, struct ss7_msgq **buffer)
 {
 	int linkid;
 
@@ -330,7 +330,7 @@ static void std_test_send(struct mtp2 *link)
 	int rllen = 0;
 	unsigned char testlen = strlen(testmessage);
 
-	m = ss7_msg_new();
+	m = ss7_msg_new(ss7, RL_MAX_SIZE + 2 + testlen);
 	if (!m) {
 		ss7_error(link->master, "Malloc failed on ss7_msg!.  Unable to transmit STD_TEST\n");
 		return;
@@ -362,7 +362,7 @@ static void std_test_send(struct mtp2 *link)
 		if (link->mtp3_timer[MTP3_TIMER_Q707_T1] > -1) {
 			ss7_schedule_del(ss7, &link->mtp3_timer[MTP3_TIMER_Q707_T1]);
 		}
-		link->mtp3_timer[MTP3_TIMER_Q707_T1] = ss7_schedule_event(ss7, link->master->mtp3_timers[MTP3_TIMER_Q707_T1], q707_t1_expiry, link);
+		link->mtp3_timer[MTP3_TIMER_Q707_T1] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_Q707_T1), link->master->mtp3_timers[MTP3_TIMER_Q707_T1], q707_t1_expiry, link);
 	}
 }
 
@@ -387,11 +387,8 @@ static void q707_t1_expiry(void *data)
 
 static inline void ss7_linkset_up_event(struct ss7 *ss7)
 {
-	ss7_event *e = ss7_next_empty_event(ss7);
-	if (!e) {
-		return;
-	}
-	e->e = SS7_STATE_UP;
+	/* Used to be SS7_STATE_UP, which has the same value but is a state */
+	ss7_next_empty_event(ss7, SS7_EVENT_UP);
 }
 
 static void linkset_up_expired(void *data)
@@ -480,7 +477,7 @@ static int ss7_check(struct ss7 *ss7)
 			if (ss7->linkset_up_timer > -1) {
 				ss7_schedule_del(ss7, &ss7->linkset_up_timer);
 			}
-			ss7->linkset_up_timer = ss7_schedule_event(ss7, LINKSET_UP_DELAY, &linkset_up_expired, ss7);
+			ss7->linkset_up_timer = ss7_schedule_event(ss7, SS7_TIMER_OTHER, LINKSET_UP_DELAY, &linkset_up_expired, ss7);
 			ss7_message(ss7, "LINKSET UP DELAYING RESETTING\n");
 		} else {
 			ss7_linkset_up_event(ss7);
@@ -498,12 +495,11 @@ static int ss7_check(struct ss7 *ss7)
 		ss7->state = SS7_STATE_DOWN;
 		if (ss7->linkset_up_timer == -1) {
 			struct mtp2 *link;
-			ss7_event *e = ss7_next_empty_event(ss7);
+			ss7_event *e = ss7_next_empty_event(ss7, SS7_EVENT_DOWN);
 
 			if (!e) {
 				return -1;
 			}
-			e->e = SS7_EVENT_DOWN;
 			isup_free_all_calls(ss7);
 
 			for (i = 0; i < ss7->numlinks; i++) {
@@ -549,7 +545,7 @@ static void mtp3_timer_q707_t2_expiry(void *data)
 	struct mtp2 *link = data;
 
 	std_test_send(link);
-	link->mtp3_timer[MTP3_TIMER_Q707_T2] = ss7_schedule_event(link->master, link->master->mtp3_timers[MTP3_TIMER_Q707_T2], mtp3_timer_q707_t2_expiry, link);
+	link->mtp3_timer[MTP3_TIMER_Q707_T2] = ss7_schedule_event(link->master, SS7_TIMER_MTP3(MTP3_TIMER_Q707_T2), link->master->mtp3_timers[MTP3_TIMER_Q707_T2], mtp3_timer_q707_t2_expiry, link);
 }
 
 static void mtp3_event_link_up(struct mtp2 * link)
@@ -559,105 +555,59 @@ static void mtp3_event_link_up(struct mtp2 * link)
 		if (link->mtp3_timer[MTP3_TIMER_Q707_T2] > -1) {
 			ss7_schedule_del(link->master, &link->mtp3_timer[MTP3_TIMER_Q707_T2]);
 		}
-		link->mtp3_timer[MTP3_TIMER_Q707_T2] = ss7_schedule_event(link->master, link->master->mtp3_timers[MTP3_TIMER_Q707_T2], mtp3_timer_q707_t2_expiry, link);
+		link->mtp3_timer[MTP3_TIMER_Q707_T2] = ss7_schedule_event(link->master, SS7_TIMER_MTP3(MTP3_TIMER_Q707_T2), link->master->mtp3_timers[MTP3_TIMER_Q707_T2], mtp3_timer_q707_t2_expiry, link);
 	}
 }
 
-static void mtp3_move_buffer(struct ss7 *ss7, struct mtp2 *link, struct ss7_msg **from, struct ss7_msg **to, int dpc, int fsn)
+static void mtp3_move_buffer(struct ss7 *ss7, struct ss7_msgq *from, struct ss7_msgq *to, int dpc, int fsn)
 {
-	struct ss7_msg *cur, *prev, *next, *dst;
-	unsigned char *buf;
-	unsigned char userpart;
-	struct routing_label rl;
+	struct ss7_msg *cur, *next;
 
 	if (fsn != -1) {
-		update_txbuf(NULL, from, fsn);
+		update_txbuf(ss7, from, fsn);
 	}
 
-	prev = NULL;
-	cur = *from;
-
-	if (to && *to) {
-		for (dst = *to; dst->next; dst = dst->next);
-	} else {
-		dst = NULL;
-	}
+	/* Rebuild from with whatever stays behind */
+	cur = from->head;
+	from->head = from->tail = NULL;
+	from->len = 0;
 
 	while (cur) {
-		buf = cur->buf;
-		userpart = get_userpart(buf[MTP2_SIZE]);
-		get_routinglabel(ss7->switchtype, buf + MTP2_SIZE + 1, &rl);
 		next = cur->next;
 
-		if (userpart > 3 && (dpc == -1 || rl.dpc == dpc)) {
-			if (cur == link->retransmit_pos) {
-				link->retransmit_pos = cur->next;
-			}
-
-			if (*from == link->tx_buf || *from == link->tx_q ||
-					*from == link->co_tx_buf || *from == link->co_tx_q) {
-				cur->size -= 2;	/* mtp2_msu increased it before!!! */
-			}
-
-			if (prev) {
-				prev->next = cur->next;
-			} else {
-				*from = cur->next;
-			}
-
+		if (cur->userpart > 3 && (dpc == -1 || cur->rl.dpc == dpc)) {
 			if (to) {
-				if (dst) {
-					dst->next = cur;
-					dst = dst->next;
-				} else {
-					*to = cur;
-					dst = cur;
-				}
-				dst->next = NULL;
+				ss7_msgq_add(to, cur);
 			} else {
-				free (cur);
+				ss7_msg_free(ss7, cur);
 			}
 		} else {
-			prev = cur;
+			ss7_msgq_add(from, cur);
 		}
 
 		cur = next;
 	}
 }
 
-static void mtp3_transmit_buffer(struct ss7 *ss7, struct ss7_msg **buf)
+static void mtp3_transmit_buffer(struct ss7 *ss7, struct ss7_msgq *buf)
 {
-	unsigned char userpart;
-	struct routing_label rl;
-	struct ss7_msg *cur = *buf, *next;
-	int priority = -1;
+	struct ss7_msg *cur = buf->head, *next;
+
+	/* mtp3_transmit() may buffer some of them here again */
+	buf->head = buf->tail = NULL;
+	buf->len = 0;
 
 	while (cur) {
 		next = cur->next;
-		userpart = get_userpart(cur->buf[MTP2_SIZE]);
-		priority = get_priority(cur->buf[MTP2_SIZE]);
-		get_routinglabel(ss7->switchtype, cur->buf + MTP2_SIZE + 1, &rl);
-		mtp3_transmit(ss7, userpart, rl, priority, cur, NULL);
+		mtp3_transmit(ss7, cur->userpart, cur->rl, cur->priority, cur, NULL);
 		cur = next;
 	}
-	*buf = NULL;
 }
 
 void mtp3_free_co(struct mtp2 *link)
 {
-	struct ss7_msg *cur;
-
-	while (link->co_tx_buf) {
-		cur = link->co_tx_buf;
-		link->co_tx_buf = link->co_tx_buf->next;
-		free(cur);
-	}
-
-	while (link->co_tx_q) {
-		cur = link->co_tx_q;
-		link->co_tx_q = link->co_tx_q->next;
-		free(cur);
-	}
+	ss7_msgq_flush(link->master, &link->co_tx_buf);
+	ss7_msgq_flush(link->master, &link->co_tx_q);
 }
 
 static void mtp3_cancel_changeover(struct mtp2 *link)
@@ -669,8 +619,8 @@ static void mtp3_cancel_changeover(struct mtp2 *link)
 		ss7_schedule_del(link->master, &link->mtp3_timer[MTP3_TIMER_T2]);
 	}
 	link->got_sent_netmsg &= ~(SENT_COO | SENT_ECO);
-	mtp3_move_buffer(link->master, link, &link->co_tx_q, &link->cb_buf, -1, -1);
-	mtp3_move_buffer(link->master, link, &link->co_buf, &link->cb_buf, -1, -1);
+	mtp3_move_buffer(link->master, &link->co_tx_q, &link->cb_buf, -1, -1);
+	mtp3_move_buffer(link->master, &link->co_buf, &link->cb_buf, -1, -1);
 	link->changeover = NO_CHANGEOVER;
 	mtp3_free_co(link);
 	ss7_message(link->master, "Changeover cancelled on link SLC %i PC %i\n", link->slc, link->dpc);
@@ -812,9 +762,9 @@ static void mtp3_changeback(struct mtp2 *link)
 			link->changeover == CHANGEOVER_INITIATED) {
 		mtp3_cancel_changeover(link);
 	} else if (link->changeover != CHANGEBACK && link->changeover != NO_CHANGEOVER) {
-		mtp3_move_buffer(link->master, link, &link->tx_q, &link->cb_buf, -1, -1);
+		mtp3_move_buffer(link->master, &link->tx_q, &link->cb_buf, -1, -1);
 		link->changeover = CHANGEBACK;
-		link->mtp3_timer[MTP3_TIMER_T3] = ss7_schedule_event(link->master, link->master->mtp3_timers[MTP3_TIMER_T3], &mtp3_t3_expired, link);
+		link->mtp3_timer[MTP3_TIMER_T3] = ss7_schedule_event(link->master, SS7_TIMER_MTP3(MTP3_TIMER_T3), link->master->mtp3_timers[MTP3_TIMER_T3], &mtp3_t3_expired, link);
 		ss7_message(link->master, "Changeback started on link SLC %i PC %i\n", link->slc, link->dpc);
 	}
 	mtp3_check(link->adj_sp);
@@ -822,7 +772,7 @@ static void mtp3_changeback(struct mtp2 *link)
 
 static void mtp3_cancel_changeback(struct mtp2 *link)
 {
-	mtp3_move_buffer(link->master, link, &link->cb_buf, &link->co_buf, -1, -1);
+	mtp3_move_buffer(link->master, &link->cb_buf, &link->co_buf, -1, -1);
 	link->changeover = NO_CHANGEOVER;
 	if (link->mtp3_timer[MTP3_TIMER_T3] > -1) {
 		ss7_schedule_del(link->master, &link->mtp3_timer[MTP3_TIMER_T3]);
@@ -855,29 +805,29 @@ static void mtp3_timed_changeover(struct mtp2 *link)
 	}
 	if (link->changeover == NO_CHANGEOVER) {
 		link->changeover = CHANGEOVER_IN_PROGRESS;
-		mtp3_move_buffer(link->master, link, &link->tx_q, &link->co_buf, -1, -1);
+		mtp3_move_buffer(link->master, &link->tx_q, &link->co_buf, -1, -1);
 		ss7_message(link->master, "Time controlled changeover initiated on link SLC: %i PC: %i\n", link->slc, link->dpc);
 		link->changeover = CHANGEOVER_IN_PROGRESS;
 		if (link->mtp3_timer[MTP3_TIMER_T1] > -1) {
 			ss7_schedule_del(link->master, &link->mtp3_timer[MTP3_TIMER_T1]);
 		}
-		link->mtp3_timer[MTP3_TIMER_T1] = ss7_schedule_event(link->master, link->master->mtp3_timers[MTP3_TIMER_T1], &mtp3_t1_expired, link);
+		link->mtp3_timer[MTP3_TIMER_T1] = ss7_schedule_event(link->master, SS7_TIMER_MTP3(MTP3_TIMER_T1), link->master->mtp3_timers[MTP3_TIMER_T1], &mtp3_t1_expired, link);
 		mtp3_free_co(link);
 	}
 }
 
 static void mtp3_changeover(struct mtp2 *link, unsigned char fsn)
 {
-	struct ss7_msg *tmp = NULL;
+	struct ss7_msgq tmp = { NULL, NULL, 0 };
 
 	if (link->changeover == CHANGEBACK || link->changeover == CHANGEBACK_INITIATED) {
 		mtp3_cancel_changeback(link);
 	}
 	if (link->changeover == NO_CHANGEOVER ||
 			link->changeover == CHANGEOVER_INITIATED) {
-		mtp3_move_buffer(link->master, link, &link->co_tx_buf, &tmp, -1, fsn);
-		mtp3_move_buffer(link->master, link, &link->co_tx_q, &tmp, -1, -1);
-		mtp3_move_buffer(link->master, link, &link->co_buf, &tmp, -1, -1);
+		mtp3_move_buffer(link->master, &link->co_tx_buf, &tmp, -1, fsn);
+		mtp3_move_buffer(link->master, &link->co_tx_q, &tmp, -1, -1);
+		mtp3_move_buffer(link->master, &link->co_buf, &tmp, -1, -1);
 		mtp3_transmit_buffer(link->master, &tmp);
 		link->changeover = CHANGEOVER_COMPLETED;
 		ss7_message (link->master, "Changeover completed on link SLC: %i PC: %i FSN: %i\n", link->slc, link->dpc, fsn);
@@ -894,15 +844,14 @@ static void mtp3_prepare_changeover(struct mtp2 *link)
 	if (link->changeover != CHANGEOVER_INITIATED) {
 		link->changeover = CHANGEOVER_INITIATED;
 		link->co_lastfsnacked = link->lastfsnacked;
-		link->co_tx_buf = link->tx_buf;
-		link->tx_buf = NULL;
+		mtp2_retrieve_txbuf(link, &link->co_tx_buf);
 		link->co_tx_q = link->tx_q;
-		link->tx_q = NULL;
-		link->retransmit_pos = NULL;
+		link->tx_q.head = link->tx_q.tail = NULL;
+		link->tx_q.len = 0;
 	}
 #if 0
-	ss7_message(link->master, "Prepare changeover co_tx_buf:%i (%i) co_buf:%i (%i) %i\n",
-			link->co_tx_buf, len_buf(link->co_tx_buf), link->co_buf, len_buf(link->co_buf), link->co_tx_q);
+	ss7_message(link->master, "Prepare changeover co_tx_buf: %i co_buf: %i co_tx_q: %i\n",
+			link->co_tx_buf.len, link->co_buf.len, link->co_tx_q.len);
 #endif
 }
 
@@ -933,7 +882,7 @@ static void mtp3_t22_expired(void *data)
 	if (link->inhibit & INHIBITED_LOCALLY) {
 		AUTORL(rl, link);
 		net_mng_send(link, NET_MNG_LLT, rl, 0);
-		link->mtp3_timer[MTP3_TIMER_T22] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T22], &mtp3_t22_expired, link);
+		link->mtp3_timer[MTP3_TIMER_T22] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T22), ss7->mtp3_timers[MTP3_TIMER_T22], &mtp3_t22_expired, link);
 	} else {
 		link->mtp3_timer[MTP3_TIMER_T22] = -1;
 	}
@@ -947,7 +896,7 @@ static void mtp3_t23_expired(void *data)
 	if (link->inhibit & INHIBITED_REMOTELY) {
 		AUTORL(rl, link);
 		net_mng_send(link, NET_MNG_LRT, rl, 0);
-		link->mtp3_timer[MTP3_TIMER_T23] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T23], &mtp3_t23_expired, link);
+		link->mtp3_timer[MTP3_TIMER_T23] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T23), ss7->mtp3_timers[MTP3_TIMER_T23], &mtp3_t23_expired, link);
 	} else {
 		link->mtp3_timer[MTP3_TIMER_T23] = -1;
 	}
@@ -975,7 +924,7 @@ static void mtp3_t10_expired(void *data)
 	rl.sls = adj_sp->links[0]->net_mng_sls;
 
 	net_mng_send(adj_sp->links[0], NET_MNG_RST, rl, route->dpc);
-	route->t10 = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T10], &mtp3_t10_expired, route);
+	route->t10 = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T10), ss7->mtp3_timers[MTP3_TIMER_T10], &mtp3_t10_expired, route);
 }
 
 static void mtp3_forced_reroute(struct adjacent_sp *adj_sp, struct mtp3_route *route)
@@ -986,12 +935,11 @@ static void mtp3_forced_reroute(struct adjacent_sp *adj_sp, struct mtp3_route *r
 
 	for (i = 0; i < adj_sp->numlinks; i++) {
 		link = adj_sp->links[i];
-		mtp3_move_buffer(ss7, link, &link->tx_q, &route->q, route->dpc, -1);
-		mtp3_move_buffer(ss7, link, &link->co_tx_q, &route->q, route->dpc, -1);
-		mtp3_move_buffer(ss7, link, &link->co_buf, &route->q, route->dpc, -1);
-		mtp3_move_buffer(ss7, link, &link->cb_buf, &route->q, route->dpc, -1);
-		mtp3_move_buffer(ss7, link, &link->tx_buf, NULL, route->dpc, -1);
-		mtp3_move_buffer(ss7, link, &link->co_tx_buf, NULL, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->tx_q, &route->q, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->co_tx_q, &route->q, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->co_buf, &route->q, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->cb_buf, &route->q, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->co_tx_buf, NULL, route->dpc, -1);
 	}
 
 	if (route->t6 > -1) {
@@ -1003,7 +951,7 @@ static void mtp3_forced_reroute(struct adjacent_sp *adj_sp, struct mtp3_route *r
 	}
 
 	if (ss7->mtp3_timers[MTP3_TIMER_T10] > 0) {
-		route->t10 = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T10], &mtp3_t10_expired, route);
+		route->t10 = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T10), ss7->mtp3_timers[MTP3_TIMER_T10], &mtp3_t10_expired, route);
 	}
 
 	mtp3_transmit_buffer(ss7, &route->q);
@@ -1033,7 +981,7 @@ static void mtp3_destroy_route(struct adjacent_sp *adj_sp, struct mtp3_route *ro
 		ss7_schedule_del(adj_sp->master, &route->t10);
 	}
 
-	mtp3_move_buffer(adj_sp->master, adj_sp->links[0], &route->q, NULL, -1, -1);
+	mtp3_move_buffer(adj_sp->master, &route->q, NULL, -1, -1);
 	free(route);
 }
 
@@ -1058,10 +1006,10 @@ static void mtp3_controlled_reroute(struct adjacent_sp *adj_sp, struct mtp3_rout
 
 	for (i = 0; i < adj_sp->numlinks; i++) {
 		link = adj_sp->links[i];
-		mtp3_move_buffer(ss7, link, &link->tx_q, &route->q, route->dpc, -1);
-		mtp3_move_buffer(ss7, link, &link->co_buf, &route->q, route->dpc, -1);
-		mtp3_move_buffer(ss7, link, &link->cb_buf, &route->q, route->dpc, -1);
-		mtp3_move_buffer(ss7, link, &link->co_tx_q, &route->q, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->tx_q, &route->q, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->co_buf, &route->q, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->cb_buf, &route->q, route->dpc, -1);
+		mtp3_move_buffer(ss7, &link->co_tx_q, &route->q, route->dpc, -1);
 	}
 
 	if (route->t6 > -1) {
@@ -1072,7 +1020,7 @@ static void mtp3_controlled_reroute(struct adjacent_sp *adj_sp, struct mtp3_rout
 		ss7_schedule_del(ss7, &route->t10);
 	}
 
-	route->t6 = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T6], &mtp3_t6_expired, route);
+	route->t6 = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T6), ss7->mtp3_timers[MTP3_TIMER_T6], &mtp3_t6_expired, route);
 }
 
 static void mtp3_add_set_route(struct adjacent_sp *adj_sp, unsigned short dpc, int state)
@@ -1168,7 +1116,7 @@ static int net_mng_receive(struct ss7 *ss7, struct mtp2 *mtp2, struct routing_la
 			}
 
 			if (ss7->mtp3_timers[MTP3_TIMER_T19] > 0 && mtp2->adj_sp->timer_t19 == -1) {
-				mtp2->adj_sp->timer_t19 = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T19], mtp3_t19_expiry, mtp2->adj_sp);
+				mtp2->adj_sp->timer_t19 = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T19), ss7->mtp3_timers[MTP3_TIMER_T19], mtp3_t19_expiry, mtp2->adj_sp);
 				ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T19 timer started PC: %i\n", mtp2->adj_sp->adjpc);
 			}
 
@@ -1262,7 +1210,7 @@ static int net_mng_receive(struct ss7 *ss7, struct mtp2 *mtp2, struct routing_la
 				mtp3_timed_changeover(winner);
 				if (ss7->mtp3_timers[MTP3_TIMER_T23] > 0) {
 					ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T23 timer started on link SLC: %i ADJPC %i\n", winner->slc, winner->dpc);
-					winner->mtp3_timer[MTP3_TIMER_T23] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T23], &mtp3_t23_expired, winner);
+					winner->mtp3_timer[MTP3_TIMER_T23] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T23), ss7->mtp3_timers[MTP3_TIMER_T23], &mtp3_t23_expired, winner);
 				}
 			} else {
 				ss7_error(ss7, "Link inhibit requested on link SLC: %i ADJPC: %i - denied\n", winner->slc, winner->dpc);
@@ -1300,7 +1248,7 @@ static int net_mng_receive(struct ss7 *ss7, struct mtp2 *mtp2, struct routing_la
 				}
 				if (ss7->mtp3_timers[MTP3_TIMER_T22] > 0) {
 					ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T22 timer started on link SLC: %i ADJPC %i\n", winner->slc, winner->dpc);
-					winner->mtp3_timer[MTP3_TIMER_T22] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T22], &mtp3_t22_expired, winner);
+					winner->mtp3_timer[MTP3_TIMER_T22] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T22), ss7->mtp3_timers[MTP3_TIMER_T22], &mtp3_t22_expired, winner);
 				}
 				if (winner->mtp3_timer[MTP3_TIMER_T14] > 0) {
 					ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T14 timer stopped on link SLC: %i ADJPC %i\n", winner->slc, winner->dpc);
@@ -1364,12 +1312,12 @@ static int net_mng_receive(struct ss7 *ss7, struct mtp2 *mtp2, struct routing_la
 static void mtp3_t2_expired(void * data)
 {
 	struct mtp2 *link = data;
-	struct ss7_msg *tmp = NULL;
+	struct ss7_msgq tmp = { NULL, NULL, 0 };
 
 	link->mtp3_timer[MTP3_TIMER_T2] = -1;
 	link->got_sent_netmsg &= ~(SENT_COO | SENT_ECO);
-	mtp3_move_buffer(link->master, link, &link->co_tx_q, &tmp, -1, -1);
-	mtp3_move_buffer(link->master, link, &link->co_buf, &tmp, -1, -1);
+	mtp3_move_buffer(link->master, &link->co_tx_q, &tmp, -1, -1);
+	mtp3_move_buffer(link->master, &link->co_buf, &tmp, -1, -1);
 	mtp3_transmit_buffer(link->master, &tmp);
 	link->changeover = CHANGEOVER_COMPLETED;
 	mtp3_free_co(link);
@@ -1399,7 +1347,7 @@ static void mtp3_t4_expired(void *data)
 	net_mng_send(link, NET_MNG_CBD, rl, link->cb_seq);
 	link->mtp3_timer[MTP3_TIMER_T4] = -1;
 	if (ss7->mtp3_timers[MTP3_TIMER_T5] > 0) {
-		link->mtp3_timer[MTP3_TIMER_T5] = ss7_schedule_event(link->master, ss7->mtp3_timers[MTP3_TIMER_T5], &mtp3_t5_expired, link);
+		link->mtp3_timer[MTP3_TIMER_T5] = ss7_schedule_event(link->master, SS7_TIMER_MTP3(MTP3_TIMER_T5), ss7->mtp3_timers[MTP3_TIMER_T5], &mtp3_t5_expired, link);
 		ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T5 timer started on link SLC: %i ADJPC: %i\n", link->slc, link->dpc);
 	}
 }
@@ -1463,7 +1411,7 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 	int rllen = 0;
 	int i, res;
 
-	m = ss7_msg_new();
+	m = ss7_msg_new(ss7, RL_MAX_SIZE + 1 + 2);	/* H0/H1 and up to 2 bytes of parameters */
 	if (!m) {
 		ss7_error(link->master, "Malloc failed on ss7_msg!.  Unable to transmit NET_MNG\n");
 		return -1;
@@ -1483,7 +1431,7 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 			link->got_sent_netmsg |= SENT_CBD;
 			if (ss7->mtp3_timers[MTP3_TIMER_T4] > 0 &&
 				link->mtp3_timer[MTP3_TIMER_T4] == -1) {	/* if 0 called from mtp3_t4_expired() */
-					link->mtp3_timer[MTP3_TIMER_T4] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T4], &mtp3_t4_expired, link);
+					link->mtp3_timer[MTP3_TIMER_T4] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T4), ss7->mtp3_timers[MTP3_TIMER_T4], &mtp3_t4_expired, link);
 					ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T4 timer started on link SLC: %i ADJPC: %i\n", link->slc, link->dpc);
 			}
 			link->cb_seq = (unsigned char) param;		/* save the CBD sequence, we may need on retransmit */
@@ -1498,7 +1446,7 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 				if (link->mtp3_timer[MTP3_TIMER_T2] > 0) {
 					ss7_schedule_del(ss7, &link->mtp3_timer[MTP3_TIMER_T2]);
 				}
-				link->mtp3_timer[MTP3_TIMER_T2] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T2], &mtp3_t2_expired, link);
+				link->mtp3_timer[MTP3_TIMER_T2] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T2), ss7->mtp3_timers[MTP3_TIMER_T2], &mtp3_t2_expired, link);
 				ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T2 timer started on link SLC: %i ADJPC: %i\n", link->slc, link->dpc);
 			}
 			/* No break here */
@@ -1512,10 +1460,10 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 			if (ss7->mtp3_timers[MTP3_TIMER_T14] > 0) {
 				ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T12 timer started on link SLC: %i ADJPC: %i\n", link->slc, link->dpc);
 				if (link->mtp3_timer[MTP3_TIMER_T12] == -1) {
-					link->mtp3_timer[MTP3_TIMER_T12] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T12],
+					link->mtp3_timer[MTP3_TIMER_T12] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T12), ss7->mtp3_timers[MTP3_TIMER_T12],
 							&mtp3_t12_expired, link);
 				} else {
-					link->mtp3_timer[MTP3_TIMER_T12] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T12],
+					link->mtp3_timer[MTP3_TIMER_T12] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T12), ss7->mtp3_timers[MTP3_TIMER_T12],
 							&mtp3_t12_expired_2nd, link);
 				}
 			}
@@ -1526,10 +1474,10 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 			if (ss7->mtp3_timers[MTP3_TIMER_T14] > 0) {
 				ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T14 timer started on link SLC: %i ADJPC: %i\n", link->slc, link->dpc);
 				if (link->mtp3_timer[MTP3_TIMER_T14] == -1) {
-					link->mtp3_timer[MTP3_TIMER_T14] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T14],
+					link->mtp3_timer[MTP3_TIMER_T14] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T14), ss7->mtp3_timers[MTP3_TIMER_T14],
 							&mtp3_t14_expired, link);
 				} else {
-					link->mtp3_timer[MTP3_TIMER_T14] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T14],
+					link->mtp3_timer[MTP3_TIMER_T14] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T14), ss7->mtp3_timers[MTP3_TIMER_T14],
 							&mtp3_t14_expired_2nd, link);
 				}
 			}
@@ -1537,7 +1485,7 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 		case NET_MNG_TRA:
 			/* we are not an stp, so we can start the T21 now */
 			if (ss7->mtp3_timers[MTP3_TIMER_T21] > 0 && link->adj_sp->timer_t21 == -1) {
-				link->adj_sp->timer_t21 = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T21],
+				link->adj_sp->timer_t21 = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T21), ss7->mtp3_timers[MTP3_TIMER_T21],
 					&mtp3_t21_expiry, link->adj_sp);
 			}
 			link->adj_sp->tra |= SENT;
@@ -1549,7 +1497,7 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 				if (link->mtp3_timer[MTP3_TIMER_T2] > -1) {
 					ss7_schedule_del(ss7, &link->mtp3_timer[MTP3_TIMER_T2]);
 				}
-				link->mtp3_timer[MTP3_TIMER_T2] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T2], &mtp3_t2_expired, link);
+				link->mtp3_timer[MTP3_TIMER_T2] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T2), ss7->mtp3_timers[MTP3_TIMER_T2], &mtp3_t2_expired, link);
 				ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T2 timer started on link SLC: %i ADJPC: %i\n", link->slc, link->dpc);
 			}
 			ss7_msg_userpart_len(m, rllen + 1);		/* no more params */
@@ -1562,10 +1510,10 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 			if (ss7->mtp3_timers[MTP3_TIMER_T13] > 0) {
 				ss7_debug_msg(ss7, SS7_DEBUG_MTP3, "MTP3 T13 timer started on link SLC: %i ADJPC: %i\n", link->slc, link->dpc);
 				if (link->mtp3_timer[MTP3_TIMER_T13] == -1) {
-					link->mtp3_timer[MTP3_TIMER_T13] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T13],
+					link->mtp3_timer[MTP3_TIMER_T13] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T13), ss7->mtp3_timers[MTP3_TIMER_T13],
 							&mtp3_t13_expired, link);
 				} else {
-					link->mtp3_timer[MTP3_TIMER_T13] = ss7_schedule_event(ss7, ss7->mtp3_timers[MTP3_TIMER_T13],
+					link->mtp3_timer[MTP3_TIMER_T13] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_T13), ss7->mtp3_timers[MTP3_TIMER_T13],
 							&mtp3_t13_expired_2nd, link);
 				}
 			}
@@ -1589,7 +1537,7 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 			break;
 		default:
 			ss7_error(link->master, "Invalid or unimplemented NET MSG!\n");
-			free (m);
+			ss7_msg_free(ss7, m);
 			return -1;
 	}
 
@@ -1616,7 +1564,7 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 
 				ss7_message(ss7, "No more signalling link to adjacent sp %d, timed changeover initiated\n", link->dpc);
 				mtp3_timed_changeover(link);
-				free (m);
+				ss7_msg_free(ss7, m);
 				return -1;
 			}
 			/* cancel changeback */
@@ -1628,7 +1576,7 @@ int net_mng_send(struct mtp2 *link, unsigned char h0h1, struct routing_label rl,
 	}
 
 	ss7_error(link->master, "No signalling link available for NET MNG: %s !!!\n", net_mng_message2str(h0h1 & 0x0f, h0h1 >> 4));
-	free (m);
+	ss7_msg_free(ss7, m);
 	return -1;
 }
 
@@ -1678,7 +1626,7 @@ static int std_test_receive(struct ss7 *ss7, struct mtp2 *mtp2, struct routing_l
 		unsigned char *layer4;
 		int rllen;
 
-		m = ss7_msg_new();
+		m = ss7_msg_new(ss7, RL_MAX_SIZE + 2 + 0xf);	/* test pattern length is 4 bits */
 		if (!m) {
 			ss7_error(ss7, "Unable to allocate message buffer!\n");
 			return -1;
@@ -1734,7 +1682,7 @@ static int std_test_receive(struct ss7 *ss7, struct mtp2 *mtp2, struct routing_l
 			mtp2->q707_t1_failed++;
 			mtp3_link_failed(mtp2);
 			if (ss7->mtp3_timers[MTP3_TIMER_Q707_T2] > 0 && mtp2->mtp3_timer[MTP3_TIMER_Q707_T2] == -1) {
-				mtp2->mtp3_timer[MTP3_TIMER_Q707_T2] = ss7_schedule_event(ss7,
+				mtp2->mtp3_timer[MTP3_TIMER_Q707_T2] = ss7_schedule_event(ss7, SS7_TIMER_MTP3(MTP3_TIMER_Q707_T2),
 						ss7->mtp3_timers[MTP3_TIMER_Q707_T2], mtp3_timer_q707_t2_expiry, mtp2);
 			}
 		}
@@ -1747,20 +1695,9 @@ fail:
 	return -1;
 }
 
-static int mtp3_to_buffer(struct ss7_msg **buf, struct ss7_msg *m)
+static int mtp3_to_buffer(struct ss7_msgq *buf, struct ss7_msg *m)
 {
-	m->next = NULL;
-
-	if (!(*buf)) {
-		*buf = m;
-		return 0;
-	}
-
-	{
-		struct ss7_msg *cur = *buf;
-		for (cur = *buf; cur->next; cur = cur->next);
-		cur->next = m;
-	}
+	ss7_msgq_add(buf, m);
 
 	return 0;
 }
@@ -1769,9 +1706,12 @@ int mtp3_transmit(struct ss7 *ss7, unsigned char userpart, struct routing_label
 {
 	unsigned char *sio;
 	struct mtp2 *winner;
-	struct ss7_msg **buffer = NULL;
+	struct ss7_msgq *buffer = NULL;
 
 	sio = m->buf + MTP2_SIZE;
+	m->userpart = userpart;
+	m->priority = priority;
+	m->rl = rl;
 
 	if (userpart == SIG_ISUP) {
 		winner = rl_to_link(ss7, rl, &buffer);
@@ -1793,7 +1733,7 @@ int mtp3_transmit(struct ss7 *ss7, unsigned char userpart, struct routing_label
 		}
 	} else {
 		ss7_error(ss7, "No siganlling link available sending message!\n");
-		free(m);
+		ss7_msg_free(ss7, m);
 		return -1;
 	}
 }
@@ -2032,51 +1972,72 @@ const char * mtp3_net_mng(struct ss7 *ss7, unsigned int slc, const char *cmd, un
 	return "OK\n";
 }
 
-int ss7_set_mtp3_timer(struct ss7 *ss7, char *name, int ms)
+static int mtp3_timer_name2id(const char *name)
 {
 	if (!strcasecmp(name, "t1")) {
-		ss7->mtp3_timers[MTP3_TIMER_T1] = ms;
+		return MTP3_TIMER_T1;
 	} else if (!strcasecmp(name, "t2")) {
-		ss7->mtp3_timers[MTP3_TIMER_T2] = ms;
+		return MTP3_TIMER_T2;
 	} else if (!strcasecmp(name, "t3")) {
-		ss7->mtp3_timers[MTP3_TIMER_T3] = ms;
+		return MTP3_TIMER_T3;
 	} else if (!strcasecmp(name, "t4")) {
-		ss7->mtp3_timers[MTP3_TIMER_T4] = ms;
+		return MTP3_TIMER_T4;
 	} else if (!strcasecmp(name, "t5")) {
-		ss7->mtp3_timers[MTP3_TIMER_T5] = ms;
+		return MTP3_TIMER_T5;
 	} else if (!strcasecmp(name, "t6")) {
-		ss7->mtp3_timers[MTP3_TIMER_T6] = ms;
+		return MTP3_TIMER_T6;
 	} else if (!strcasecmp(name, "t7")) {
-		ss7->mtp3_timers[MTP3_TIMER_T7] = ms;
+		return MTP3_TIMER_T7;
 	} else if (!strcasecmp(name, "t10")) {
-		ss7->mtp3_timers[MTP3_TIMER_T10] = ms;
+		return MTP3_TIMER_T10;
 	} else if (!strcasecmp(name, "t12")) {
-		ss7->mtp3_timers[MTP3_TIMER_T12] = ms;
+		return MTP3_TIMER_T12;
 	} else if (!strcasecmp(name, "t13")) {
-		ss7->mtp3_timers[MTP3_TIMER_T13] = ms;
+		return MTP3_TIMER_T13;
 	} else if (!strcasecmp(name, "t14")) {
-		ss7->mtp3_timers[MTP3_TIMER_T14] = ms;
+		return MTP3_TIMER_T14;
 	} else if (!strcasecmp(name, "t19")) {
-		ss7->mtp3_timers[MTP3_TIMER_T19] = ms;
+		return MTP3_TIMER_T19;
 	} else if (!strcasecmp(name, "t21")) {
-		ss7->mtp3_timers[MTP3_TIMER_T21] = ms;
+		return MTP3_TIMER_T21;
 	} else if (!strcasecmp(name, "t22")) {
-		ss7->mtp3_timers[MTP3_TIMER_T22] = ms;
+		return MTP3_TIMER_T22;
 	} else if (!strcasecmp(name, "t23")) {
-		ss7->mtp3_timers[MTP3_TIMER_T23] = ms;
+		return MTP3_TIMER_T23;
 	} else if (!strcasecmp(name, "q707_t1")) {
-		ss7->mtp3_timers[MTP3_TIMER_Q707_T1] = ms;
+		return MTP3_TIMER_Q707_T1;
 	} else if (!strcasecmp(name, "q707_t2")) {
-		ss7->mtp3_timers[MTP3_TIMER_Q707_T2] = ms;
-	} else {
+		return MTP3_TIMER_Q707_T2;
+	}
+	return 0;
+}
+
+int ss7_set_mtp3_timer(struct ss7 *ss7, char *name, int ms)
+{
+	int timer = mtp3_timer_name2id(name);
+
+	if (!timer) {
 		ss7_message(ss7, "Unknown MTP3 timer: %s\n", name);
 		return 0;
 	}
-
+	ss7->mtp3_timers[timer] = ms;
 	ss7_message(ss7, "MTP3 timer %s = %ims\n", name, ms);
 	return 1;
 }
 
+int ss7_set_mtp3_timer_slack(struct ss7 *ss7, char *name, int ms)
+{
+	int timer = mtp3_timer_name2id(name);
+
+	if (!timer) {
+		ss7_message(ss7, "Unknown MTP3 timer: %s\n", name);
+		return 0;
+	}
+	ss7->timer_slack[SS7_TIMER_MTP3(timer)] = ms;
+	ss7_message(ss7, "MTP3 timer %s slack = %ims\n", name, ms);
+	return 1;
+}
+
 char * mtp3_timer2str(int mtp3_timer)
 {
 	switch (mtp3_timer) {
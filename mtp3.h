@@ -48,6 +48,7 @@
 #define PRIORITY_3		0x03
 
 #define SIO_SIZE	1
+#define RL_MAX_SIZE	7	/* ANSI routing label, ITU is 4 */
 
 #define MTP2_LINKSTATE_DOWN		0
 #define MTP2_LINKSTATE_INALARM	1
@@ -160,9 +161,9 @@ struct net_mng_message {
 struct mtp3_route {
 	int state;
 	unsigned int dpc;
-	int t6;
-	int t10;
-	struct ss7_msg *q;
+	long long t6;
+	long long t10;
+	struct ss7_msgq q;
 	struct adjacent_sp *owner;
 	struct mtp3_route *next;
 };
@@ -172,8 +173,8 @@ struct adjacent_sp {
 	unsigned int adjpc;
 	struct mtp2 *links[SS7_MAX_LINKS];
 	unsigned int numlinks;
-	int timer_t19;
-	int timer_t21;
+	long long timer_t19;
+	long long timer_t21;
 	unsigned int tra;
 	struct ss7 *master;
 	struct mtp3_route *routes;
@@ -29,14 +29,25 @@
  * terms granted here.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE	/* recvmmsg() */
+#endif
+
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#endif
 #include "libss7.h"
 #include "ss7_internal.h"
 #include "mtp2.h"
@@ -138,14 +149,125 @@ void ss7_dump_msg(struct ss7 *ss7, unsigned char *buf, int len)
 	ss7_message(ss7, "Len = %d [ %s]\n", len, tmp);
 }
 
-void ss7_msg_free(struct ss7_msg *m)
+static const int ss7_msg_sizes[SS7_MSG_CLASSES] = { SS7_MSG_SMALL, SS7_MSG_LARGE };
+
+void ss7_msg_free(struct ss7 *ss7, struct ss7_msg *m)
 {
-	free(m);
+	int class = m->msg_class;
+
+	ss7->msg_in_use[class]--;
+
+	if (ss7->msg_free_len[class] >= ss7->msg_pool_max) {
+		free(m);
+		return;
+	}
+
+	m->next = ss7->msg_free[class];
+	ss7->msg_free[class] = m;
+	ss7->msg_free_len[class]++;
 }
 
-struct ss7_msg * ss7_msg_new(void)
+struct ss7_msg * ss7_msg_new(struct ss7 *ss7, int len)
 {
-	return calloc(1, sizeof(struct ss7_msg));
+	struct ss7_msg *m;
+	int class;
+
+	if (MTP2_SIZE + SIO_SIZE + len + MTP2_FCS_SIZE <= SS7_MSG_SMALL) {
+		class = SS7_MSG_CLASS_SMALL;
+	} else {
+		class = SS7_MSG_CLASS_LARGE;
+	}
+
+	ss7->msg_allocs[class]++;
+
+	if ((m = ss7->msg_free[class])) {
+		ss7->msg_free[class] = m->next;
+		ss7->msg_free_len[class]--;
+		memset(m, 0, sizeof(*m) + ss7_msg_sizes[class]);
+	} else {
+		ss7->msg_mallocs[class]++;
+		if (!(m = calloc(1, sizeof(*m) + ss7_msg_sizes[class]))) {
+			return NULL;
+		}
+	}
+	m->msg_class = class;
+
+	if (++ss7->msg_in_use[class] > ss7->msg_hwm[class]) {
+		ss7->msg_hwm[class] = ss7->msg_in_use[class];
+	}
+
+	return m;
+}
+
+void ss7_msgq_add(struct ss7_msgq *q, struct ss7_msg *m)
+{
+	m->next = NULL;
+
+	if (q->tail) {
+		q->tail->next = m;
+	} else {
+		q->head = m;
+	}
+	q->tail = m;
+	q->len++;
+}
+
+struct ss7_msg * ss7_msgq_pop(struct ss7_msgq *q)
+{
+	struct ss7_msg *m = q->head;
+
+	if (m) {
+		q->head = m->next;
+		if (!q->head) {
+			q->tail = NULL;
+		}
+		q->len--;
+		m->next = NULL;
+	}
+
+	return m;
+}
+
+void ss7_msgq_flush(struct ss7 *ss7, struct ss7_msgq *q)
+{
+	struct ss7_msg *m;
+
+	while ((m = ss7_msgq_pop(q))) {
+		ss7_msg_free(ss7, m);
+	}
+}
+
+int ss7_set_msg_pool(struct ss7 *ss7, int prealloc, int max)
+{
+	struct ss7_msg *m;
+	int class;
+
+	if (!ss7 || prealloc < 0 || max < 0) {
+		return -1;
+	}
+
+	ss7->msg_pool_max = max > prealloc ? max : prealloc;
+
+	for (class = 0; class < SS7_MSG_CLASSES; class++) {
+		while (ss7->msg_free_len[class] > ss7->msg_pool_max) {
+			m = ss7->msg_free[class];
+			ss7->msg_free[class] = m->next;
+			ss7->msg_free_len[class]--;
+			free(m);
+		}
+
+		while (ss7->msg_free_len[class] < prealloc) {
+			if (!(m = malloc(sizeof(*m) + ss7_msg_sizes[class]))) {
+				return -1;
+			}
+			m->msg_class = class;
+			m->next = ss7->msg_free[class];
+			ss7->msg_free[class] = m;
+			ss7->msg_free_len[class]++;
+		}
+	}
+
+	return 0;
 }
 
 unsigned char * ss7_msg_userpart(struct ss7_msg *msg)
@@ -159,36 +281,498 @@ void ss7_msg_userpart_len(struct ss7_msg *msg, int len)
 	return;
 }
 
-ss7_event * ss7_next_empty_event(struct ss7 *ss7)
+int ss7_msg_userpart_max(struct ss7_msg *msg)
+{
+	return ss7_msg_sizes[msg->msg_class] - MTP2_SIZE - SIO_SIZE - MTP2_FCS_SIZE;
+}
+
+static int ss7_event_grow(struct ss7 *ss7, struct ss7_evq *lane)
+{
+	int size = lane->size ? lane->size * 2 : SS7_EVENTS_INITIAL;
+	ss7_event *q;
+	int x;
+
+	/* At the limit, a ring of the same size still frees the slots held by
+	 * the application */
+	if (ss7->ev_max && size > ss7->ev_max) {
+		size = ss7->ev_max > lane->size ? ss7->ev_max : lane->size;
+	}
+	if (size <= lane->len) {
+		return -1;
+	}
+
+	if (!(q = malloc(size * sizeof(*q)))) {
+		return -1;
+	}
+	/* Unwrap the ring so the new one starts at the head */
+	for (x = 0; x < lane->len; x++) {
+		q[x] = lane->q[(lane->h + x) % lane->size];
+	}
+
+	/* The events returned by the last ss7_check_event(s)() live in the ring
+	 * they were taken from, keep that one until the application asks for
+	 * more.  Same for the ring of an event a handler is working on. */
+	if (!lane->q_old) {
+		lane->q_old = lane->q;
+	} else if (lane->q == ss7->ev_disp_ring) {
+		ss7->ev_q_disp = lane->q;
+	} else {
+		free(lane->q);
+	}
+	lane->q = q;
+	lane->size = size;
+	lane->h = 0;
+	lane->out = 0;
+
+	return 0;
+}
+
+static inline int ss7_event_lane(int type)
+{
+	switch (type) {
+		case SS7_EVENT_UP:
+		case SS7_EVENT_DOWN:
+		case MTP2_LINK_UP:
+		case MTP2_LINK_DOWN:
+			return SS7_EVENT_LANE_MNG;
+		default:
+			/* Anything for a CIC stays in order with that CIC's calls */
+			return SS7_EVENT_LANE_CALL;
+	}
+}
+
+ss7_event * ss7_next_empty_event(struct ss7 *ss7, int type)
 {
+	struct ss7_evq *lane = &ss7->ev_lanes[ss7_event_lane(type)];
 	ss7_event *e;
 
-	if (ss7->ev_len == MAX_EVENTS) {
-		/* Should never happen.  If it does, very bad things can happen to the call. */
-		ss7_error(ss7, "Event queue full!  Very bad!\n");
+	if ((ss7->ev_max && ss7->ev_len >= ss7->ev_max) ||
+		(lane->len + lane->out >= lane->size && ss7_event_grow(ss7, lane))) {
+		/* Very bad things can happen to the call the event was for */
+		ss7->ev_dropped++;
+		ss7_error(ss7, "Event queue full (%i events pending)!  Very bad!\n", ss7->ev_len);
 		return NULL;
 	}
 
-	e = &ss7->ev_q[(ss7->ev_h + ss7->ev_len) % MAX_EVENTS];
+	e = &lane->q[(lane->h + lane->len) % lane->size];
+	e->e = type;
+	lane->len += 1;
+	lane->queued += 1;
+	if (lane->len > lane->hwm) {
+		lane->hwm = lane->len;
+	}
 	ss7->ev_len += 1;
+	if (ss7->ev_len > ss7->ev_hwm) {
+		ss7->ev_hwm = ss7->ev_len;
+	}
 
 	return e;
 }
 
+/* The lane to take the next event from, NULL if nothing is pending */
+static inline struct ss7_evq * ss7_event_next_lane(struct ss7 *ss7)
+{
+	int x;
+
+	for (x = 0; x < SS7_EVENT_LANES; x++) {
+		if (ss7->ev_lanes[x].len) {
+			return &ss7->ev_lanes[x];
+		}
+	}
+
+	return NULL;
+}
+
+static inline void ss7_event_pop(struct ss7 *ss7, struct ss7_evq *lane)
+{
+	lane->h += 1;
+	lane->h %= lane->size;
+	lane->len -= 1;
+	ss7->ev_len -= 1;
+}
+
+static struct ss7_ring *ss7_ring_new(int size, size_t slot_size)
+{
+#ifdef __linux__
+	struct ss7_ring *r;
+	void *p;
+	unsigned int n = 1;
+
+	while (n < size) {
+		n <<= 1;
+	}
+
+	if (posix_memalign(&p, 64, sizeof(*r))) {
+		return NULL;
+	}
+	r = p;
+	memset(r, 0, sizeof(*r));
+	r->size = n;
+	r->wake_fd = -1;
+
+	if (!(r->slots = calloc(n, slot_size))) {
+		free(r);
+		return NULL;
+	}
+	if ((r->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		free(r->slots);
+		free(r);
+		return NULL;
+	}
+
+	return r;
+#else
+	return NULL;
+#endif
+}
+
+static void ss7_ring_free(struct ss7_ring *r)
+{
+	if (!r) {
+		return;
+	}
+
+	close(r->fd);
+	free(r->slots);
+	free(r);
+}
+
+static void ss7_ring_wake(int fd)
+{
+	unsigned long long one = 1;
+
+	if (write(fd, &one, sizeof(one)) < 0) {
+		/* Only fails when the counter is saturated, it is readable then */
+	}
+}
+
+/* Producer: the slot to fill next, -1 if the ring is full */
+static int ss7_ring_slot(struct ss7_ring *r)
+{
+	if (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) < r->size) {
+		return r->head & (r->size - 1);
+	}
+
+	/* Ask the consumer for a wakeup, then look again in case it made room
+	 * before it could see the flag */
+	__atomic_store_n(&r->stalled, 1, __ATOMIC_SEQ_CST);
+	if (r->head - __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) < r->size) {
+		return r->head & (r->size - 1);
+	}
+
+	return -1;
+}
+
+/* Producer: hand the filled slot to the consumer */
+static void ss7_ring_push(struct ss7_ring *r)
+{
+	/* Read by ss7_show_linkset() from the I/O thread */
+	__atomic_store_n(&r->published, r->published + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/* Consumer: release the slot taken last time and return the next one, -1 if
+ * the ring is empty */
+static int ss7_ring_take(struct ss7_ring *r)
+{
+	unsigned long long count;
+
+	if (r->taken) {
+		r->taken = 0;
+		__atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_SEQ_CST);
+		if (__atomic_exchange_n(&r->stalled, 0, __ATOMIC_SEQ_CST) && r->wake_fd > -1) {
+			ss7_ring_wake(r->wake_fd);
+		}
+	}
+
+	if (r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+		/* Clear the fd before looking again, so a push racing with this
+		 * leaves it readable */
+		if (read(r->fd, &count, sizeof(count)) < 0) {
+			/* Nothing to clear */
+		}
+		if (r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+			return -1;
+		}
+	}
+	r->taken = 1;
+
+	return r->tail & (r->size - 1);
+}
+
+int ss7_set_event_ring(struct ss7 *ss7, int size)
+{
+	if (!ss7 || size < 0) {
+		return -1;
+	}
+
+	if (ss7->ev_ring) {
+		return ss7->ev_ring->fd;
+	}
+
+	/* NOCOPY events point into calls that the I/O thread keeps changing */
+	if (ss7->flags & SS7_EVENT_NOCOPY) {
+		ss7_error(ss7, "SS7_EVENT_NOCOPY can't be used with the event ring\n");
+		return -1;
+	}
+
+	if (!size) {
+		size = SS7_EVENT_RING_SIZE;
+	}
+
+	if (!(ss7->cmd_ring = ss7_ring_new(size, sizeof(struct ss7_command)))) {
+		return -1;
+	}
+	if (!(ss7->ev_ring = ss7_ring_new(size, sizeof(ss7_event)))) {
+		ss7_ring_free(ss7->cmd_ring);
+		ss7->cmd_ring = NULL;
+		return -1;
+	}
+	/* Events left queued for lack of room go out from ss7_run_commands() */
+	ss7->ev_ring->wake_fd = ss7->cmd_ring->fd;
+
+	return ss7->ev_ring->fd;
+}
+
+ss7_event * ss7_ring_get_event(struct ss7 *ss7)
+{
+	int x;
+
+	if (!ss7->ev_ring || (x = ss7_ring_take(ss7->ev_ring)) < 0) {
+		return NULL;
+	}
+
+	return &((ss7_event *) ss7->ev_ring->slots)[x];
+}
+
+int ss7_ring_command(struct ss7 *ss7, ss7_command_fn fn, void *data)
+{
+	struct ss7_command *c;
+	int x;
+
+	if (!ss7->cmd_ring || !fn || (x = ss7_ring_slot(ss7->cmd_ring)) < 0) {
+		return -1;
+	}
+
+	c = &((struct ss7_command *) ss7->cmd_ring->slots)[x];
+	c->fn = fn;
+	c->data = data;
+	ss7_ring_push(ss7->cmd_ring);
+	ss7_ring_wake(ss7->cmd_ring->fd);
+
+	return 0;
+}
+
+int ss7_get_command_fd(struct ss7 *ss7)
+{
+	return ss7->cmd_ring ? ss7->cmd_ring->fd : -1;
+}
+
+int ss7_run_commands(struct ss7 *ss7)
+{
+	struct ss7_command *c;
+	int x, n = 0;
+
+	if (!ss7->cmd_ring) {
+		return 0;
+	}
+
+	while ((x = ss7_ring_take(ss7->cmd_ring)) > -1) {
+		c = &((struct ss7_command *) ss7->cmd_ring->slots)[x];
+		c->fn(ss7, c->data);
+		n++;
+	}
+
+	/* Events the commands queued, and those that were waiting for room */
+	ss7_dispatch_events(ss7);
+
+	return n;
+}
+
+static inline int ss7_event_handled(struct ss7 *ss7, ss7_event *e)
+{
+	return e->e >= 0 && e->e < SS7_MAX_EVENT_TYPES && ss7->ev_handler[e->e].fn;
+}
+
+void ss7_dispatch_events(struct ss7 *ss7)
+{
+	struct ss7_evq *lane;
+	ss7_event *e;
+	int x, published = 0;
+
+	/* Events queued by a handler are picked up by the loop below */
+	if (ss7->ev_dispatching) {
+		return;
+	}
+	ss7->ev_dispatching = 1;
+
+	while ((lane = ss7_event_next_lane(ss7))) {
+		if (!ss7_event_handled(ss7, &lane->q[lane->h])) {
+			/* Stop at the first event nobody handles, it goes to
+			 * ss7_check_event() or waits for room in the event ring */
+			if (!ss7->ev_ring || (x = ss7_ring_slot(ss7->ev_ring)) < 0) {
+				break;
+			}
+			e = &((ss7_event *) ss7->ev_ring->slots)[x];
+			*e = lane->q[lane->h];
+			ss7_event_pop(ss7, lane);
+			mtp3_process_event(ss7, e);
+			ss7_ring_push(ss7->ev_ring);
+			published++;
+			continue;
+		}
+
+		/* Leave it at the head so nothing queued meanwhile can take its slot */
+		e = &lane->q[lane->h];
+		ss7->ev_disp_ring = lane->q;
+		mtp3_process_event(ss7, e);
+		ss7->ev_handler[e->e].fn(ss7, e, ss7->ev_handler[e->e].data);
+
+		ss7_event_pop(ss7, lane);
+		if (ss7->ev_q_disp) {
+			free(ss7->ev_q_disp);
+			ss7->ev_q_disp = NULL;
+		}
+	}
+
+	if (published) {
+		ss7_ring_wake(ss7->ev_ring->fd);
+	}
+
+	ss7->ev_disp_ring = NULL;
+	ss7->ev_dispatching = 0;
+}
+
+int ss7_set_event_handler(struct ss7 *ss7, int type, ss7_event_handler fn, void *data)
+{
+	if (!ss7 || type < 0 || type >= SS7_MAX_EVENT_TYPES) {
+		return -1;
+	}
+
+	ss7->ev_handler[type].fn = fn;
+	ss7->ev_handler[type].data = data;
+
+	return 0;
+}
+
+int ss7_check_events(struct ss7 *ss7, ss7_event **ev, int max)
+{
+	struct ss7_evq *lane;
+	int n, x;
+
+	/* Not from inside a handler, the application may still be holding the
+	 * batch it got from its own call */
+	if (ss7->ev_dispatching) {
+		return 0;
+	}
+
+	/* The application is done with the previous batch */
+	for (x = 0; x < SS7_EVENT_LANES; x++) {
+		free(ss7->ev_lanes[x].q_old);
+		ss7->ev_lanes[x].q_old = NULL;
+		ss7->ev_lanes[x].out = 0;
+	}
+
+	ss7_dispatch_events(ss7);
+
+	/* Everything goes to the call thread */
+	if (ss7->ev_ring) {
+		ss7->sched_now_cached = 0;
+		return 0;
+	}
+
+	for (n = 0; n < max && (lane = ss7_event_next_lane(ss7)); n++) {
+		/* Handled events behind this batch wait for the next call */
+		if (n && ss7_event_handled(ss7, &lane->q[lane->h])) {
+			break;
+		}
+		ev[n] = &lane->q[lane->h];
+		ss7_event_pop(ss7, lane);
+		lane->out += 1;
+	}
+
+	/* MTP3 link up/down bookkeeping, may queue further events */
+	for (x = 0; x < n; x++) {
+		mtp3_process_event(ss7, ev[x]);
+	}
+
+	/* Drained, the time from ss7_clock_tick() is done with */
+	if (!n) {
+		ss7->sched_now_cached = 0;
+	}
+
+	return n;
+}
+
 ss7_event * ss7_check_event(struct ss7 *ss7)
 {
 	ss7_event *e;
 
-	if (!ss7->ev_len) {
+	if (!ss7_check_events(ss7, &e, 1)) {
 		return NULL;
-	} else {
-		e = &ss7->ev_q[ss7->ev_h];
 	}
-	ss7->ev_h += 1;
-	ss7->ev_h %= MAX_EVENTS;
-	ss7->ev_len -= 1;
 
-	return mtp3_process_event(ss7, e);
+	return e;
+}
+
+void ss7_set_max_events(struct ss7 *ss7, int max)
+{
+	if (!ss7 || max < 0) {
+		return;
+	}
+
+	ss7->ev_max = max;
+}
+
+int ss7_set_event_watermarks(struct ss7 *ss7, int high, int low)
+{
+	if (!ss7 || high < 0 || low < 0 || (high && low >= high)) {
+		return -1;
+	}
+
+	ss7->ev_high = high;
+	ss7->ev_low = low;
+	if (!high && ss7->ev_throttled) {
+		int i;
+
+		ss7->ev_throttled = 0;
+		for (i = 0; i < ss7->numlinks; i++) {
+			mtp2_set_busy(ss7->links[i], 0);
+		}
+	}
+
+	return 0;
+}
+
+/* Mark the links busy (SIB, MSUs left unacknowledged) while the event
+ * backlog is too deep to take in more MSUs */
+static void ss7_update_busy(struct ss7 *ss7)
+{
+	int backlog = ss7->ev_len;
+	int i;
+
+	if (!ss7->ev_high) {
+		return;
+	}
+
+	if (ss7->ev_ring) {
+		backlog += ss7->ev_ring->head - __atomic_load_n(&ss7->ev_ring->tail, __ATOMIC_ACQUIRE);
+	}
+
+	if (!ss7->ev_throttled && backlog >= ss7->ev_high) {
+		ss7->ev_throttled = 1;
+		ss7->ev_throttle_count++;
+		ss7_debug_msg(ss7, SS7_DEBUG_MTP2, "%i events pending, links busy\n", backlog);
+		for (i = 0; i < ss7->numlinks; i++) {
+			mtp2_set_busy(ss7->links[i], 1);
+		}
+	} else if (ss7->ev_throttled && backlog <= ss7->ev_low) {
+		ss7->ev_throttled = 0;
+		ss7_debug_msg(ss7, SS7_DEBUG_MTP2, "%i events pending, links no longer busy\n", backlog);
+		for (i = 0; i < ss7->numlinks; i++) {
+			mtp2_set_busy(ss7->links[i], 0);
+		}
+	}
 }
 
 int ss7_start(struct ss7 *ss7)
@@ -215,10 +799,10 @@ static int ss7_set_adjpc(struct mtp2 *mtp2, unsigned int pc)
 	return 0;
 }
 
-int ss7_add_link(struct ss7 *ss7, int transport, int fd, int slc, unsigned int adjpc)
+struct mtp2 * ss7_add_link_handle(struct ss7 *ss7, int transport, int fd, int slc, unsigned int adjpc)
 {
 	if (ss7->numlinks >= SS7_MAX_LINKS) {
-		return -1;
+		return NULL;
 	}
 
 	if ((transport == SS7_TRANSPORT_DAHDIDCHAN) || (transport == SS7_TRANSPORT_DAHDIMTP2)) {
@@ -226,7 +810,7 @@ int ss7_add_link(struct ss7 *ss7, int transport, int fd, int slc, unsigned int a
 
 		m = mtp2_new(fd, ss7->switchtype);
 		if (!m) {
-			return -1;
+			return NULL;
 		}
 
 		m->master = ss7;
@@ -235,16 +819,37 @@ int ss7_add_link(struct ss7 *ss7, int transport, int fd, int slc, unsigned int a
 			m->flags |= MTP2_FLAG_DAHDIMTP2;
 		}
 
+		{
+			int fl = fcntl(fd, F_GETFL);
+			struct stat st;
+
+			if (fl > -1 && (fl & O_NONBLOCK)) {
+				m->flags |= MTP2_FLAG_NONBLOCK;
+			}
+#ifdef __linux__
+			if (!fstat(fd, &st) && S_ISSOCK(st.st_mode)) {
+				m->flags |= MTP2_FLAG_SOCKET;
+			}
+#else
+			(void) st;
+#endif
+		}
+
 		m->slc = (slc > -1) ? slc : ss7->numlinks;
 		ss7->numlinks++;
 
 		ss7->links[ss7->numlinks - 1] = m;
 		ss7_set_adjpc(ss7->links[ss7->numlinks-1], adjpc);
 
-		return 0;
+		return m;
 	}
 
-	return -1;
+	return NULL;
+}
+
+int ss7_add_link(struct ss7 *ss7, int transport, int fd, int slc, unsigned int adjpc)
+{
+	return ss7_add_link_handle(ss7, transport, fd, slc, adjpc) ? 0 : -1;
 }
 
 int ss7_find_link_index(struct ss7 *ss7, int fd)
@@ -272,6 +877,9 @@ int ss7_pollflags(struct ss7 *ss7, int fd)
 		return -1;
 	}
 
+	/* The backlog may have drained since the last read */
+	ss7_update_busy(ss7);
+
 	if (ss7->links[winner]->flags & MTP2_FLAG_DAHDIMTP2) {
 		if (ss7->links[winner]->flags & MTP2_FLAG_WRITE) {
 			flags |= POLLOUT;
@@ -383,8 +991,8 @@ struct ss7 *ss7_new(int switchtype)
 	}
 
 	/* Initialize the event queue */
-	s->ev_h = 0;
 	s->ev_len = 0;
+	s->ev_max = SS7_MAX_EVENTS;
 	s->state = SS7_STATE_DOWN;
 	s->switchtype = switchtype;
 
@@ -393,6 +1001,10 @@ struct ss7 *ss7_new(int switchtype)
 	}
 
 	s->linkset_up_timer = -1;
+	s->sched_timerfd = -1;
+	s->msg_pool_max = SS7_MSG_POOL_MAX;
+	s->tx_budget = SS7_TX_BUDGET;
+	s->rx_budget = SS7_RX_BUDGET;
 
 	s->flags = SS7_ISDN_ACCESS_INDICATOR;
 	s->sls_shift = 0;
@@ -424,6 +1036,27 @@ void ss7_destroy(struct ss7 *ss7)
 		free(ss7->links[i]);
 	}
 
+	if (ss7->sched_timerfd > -1) {
+		close(ss7->sched_timerfd);
+	}
+	for (i = 0; i < SS7_EVENT_LANES; i++) {
+		free(ss7->ev_lanes[i].q);
+		free(ss7->ev_lanes[i].q_old);
+	}
+	free(ss7->ev_q_disp);
+	ss7_ring_free(ss7->ev_ring);
+	ss7_ring_free(ss7->cmd_ring);
+	for (i = 0; i < SS7_MSG_CLASSES; i++) {
+		while (ss7->msg_free[i]) {
+			struct ss7_msg *m = ss7->msg_free[i];
+
+			ss7->msg_free[i] = m->next;
+			free(m);
+		}
+	}
+	free(ss7->ss7_sched);
+	free(ss7->sched_heap);
+	free(ss7->timer_stats);
 	free(ss7);
 }
 
@@ -442,6 +1075,11 @@ void ss7_set_flags(struct ss7 *ss7, unsigned int flags)
 		return;
 	}
 
+	if ((flags & SS7_EVENT_NOCOPY) && ss7->ev_ring) {
+		ss7_error(ss7, "SS7_EVENT_NOCOPY can't be used with the event ring\n");
+		flags &= ~SS7_EVENT_NOCOPY;
+	}
+
 	ss7->flags |= flags;
 }
 
@@ -463,40 +1101,158 @@ void ss7_set_cause_location(struct ss7 *ss7, unsigned char location)
 	ss7->cause_location = 0x0f & location;
 }
 
+int ss7_set_tx_budget(struct ss7 *ss7, int max)
+{
+	if (!ss7 || max < 1) {
+		return -1;
+	}
+
+	ss7->tx_budget = max;
+
+	return 0;
+}
+
 int ss7_write(struct ss7 *ss7, int fd)
 {
 	int res;
+	int sent = 0;
 	int winner = ss7_find_link_index(ss7, fd);
 
 	if (winner < 0) {
 		return -1;
 	}
 
-	res = mtp2_transmit(ss7->links[winner]);
+	/* One frame per write(), HDLC channels don't keep writev() iovecs apart.
+	 * A blocking fd only gets the one write poll() promised. */
+	do {
+		res = mtp2_transmit(ss7->links[winner]);
+		if (res <= 0) {
+			break;
+		}
+		sent++;
+	} while ((ss7->links[winner]->flags & MTP2_FLAG_NONBLOCK) && sent < ss7->tx_budget && mtp2_tx_pending(ss7->links[winner]));
+	ss7->sched_now_cached = 0;
 
-	return res;
+	return sent ? sent : res;
+}
+
+int ss7_set_rx_budget(struct ss7 *ss7, int max)
+{
+	if (!ss7 || max < 1) {
+		return -1;
+	}
+
+	ss7->rx_budget = max;
+
+	return 0;
+}
+
+#ifdef __linux__
+static int ss7_read_mmsg(struct ss7 *ss7, struct mtp2 *link)
+{
+	unsigned char buf[SS7_RX_BATCH][512];
+	struct iovec iov[SS7_RX_BATCH];
+	struct mmsghdr msgs[SS7_RX_BATCH];
+	int i, res, want, n = 0;
+
+	do {
+		want = ss7->rx_budget - n;
+		if (want > SS7_RX_BATCH) {
+			want = SS7_RX_BATCH;
+		}
+
+		memset(msgs, 0, sizeof(msgs[0]) * want);
+		for (i = 0; i < want; i++) {
+			iov[i].iov_base = buf[i];
+			iov[i].iov_len = sizeof(buf[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		res = recvmmsg(link->fd, msgs, want, MSG_DONTWAIT, NULL);
+		if (res <= 0) {
+			break;
+		}
+
+		for (i = 0; i < res; i++) {
+			mtp2_receive(link, buf[i], msgs[i].msg_len);
+		}
+		n += res;
+		ss7_update_busy(ss7);
+	} while (res == want && n < ss7->rx_budget);
+
+	return n ? n : res;
 }
+#endif
 
 int ss7_read(struct ss7 *ss7, int fd)
 {
 	int res;
+	int n = 0;
 	int winner = ss7_find_link_index(ss7, fd);
+	struct mtp2 *link;
 	unsigned char buf[1024];
 
 	if (winner < 0) {
 		return -1;
 	}
 
-	res = read(ss7->links[winner]->fd, buf, sizeof(buf));
-	if (res <= 0) {
+	link = ss7->links[winner];
+
+#ifdef __linux__
+	if (link->flags & MTP2_FLAG_SOCKET) {
+		res = ss7_read_mmsg(ss7, link);
+		if (res > 0) {
+			ss7_dispatch_events(ss7);
+		}
+		ss7->sched_now_cached = 0;
 		return res;
 	}
+#endif
+
+	/* A blocking fd only gets the one read poll() promised */
+	do {
+		res = read(link->fd, buf, sizeof(buf));
+		if (res <= 0) {
+			break;
+		}
+		mtp2_receive(link, buf, res);
+		n++;
+		ss7_update_busy(ss7);
+	} while ((link->flags & MTP2_FLAG_NONBLOCK) && n < ss7->rx_budget);
+
+	if (n) {
+		ss7_dispatch_events(ss7);
+	}
+	ss7->sched_now_cached = 0;
 
-	res = mtp2_receive(ss7->links[winner], buf, res);
+	return n ? n : res;
+}
+
+int ss7_receive_su(struct ss7 *ss7, struct mtp2 *link, unsigned char *buf, int len)
+{
+	int res;
+
+	if (!ss7 || !link || link->master != ss7) {
+		return -1;
+	}
+
+	res = mtp2_receive(link, buf, len);
+	ss7_update_busy(ss7);
+	ss7_dispatch_events(ss7);
 
 	return res;
 }
 
+int ss7_transmit_su(struct ss7 *ss7, struct mtp2 *link, unsigned char *buf, int len)
+{
+	if (!ss7 || !link || link->master != ss7) {
+		return -1;
+	}
+
+	return mtp2_transmit_buf(link, buf, len);
+}
+
 static inline char * changeover2str(int state)
 {
 	switch(state) {
@@ -610,7 +1366,7 @@ void ss7_pc_to_str(int ss7type, unsigned int pc, char *str)
 
 void ss7_show_linkset(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd)
 {
-	int j, i, x;
+	int j, i, x, left;
 	char *p;
 	char got_sent_buf[256], timers[512];
 	struct adjacent_sp *adj_sp;
@@ -625,6 +1381,38 @@ void ss7_show_linkset(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd)
 	cust_printf(fd, "SLS shift: %i\n", ss7->sls_shift);
 	cust_printf(fd, "numlinks: %i\n", ss7->numlinks);
 	cust_printf(fd, "numsps: %i\n", ss7->numsps);
+	cust_printf(fd, "Timers: %i armed, %i high-water, %i slots", ss7->sched_len, ss7->sched_hwm, ss7->sched_size);
+	if (ss7->sched_max) {
+		cust_printf(fd, ", limit %i\n", ss7->sched_max);
+	} else {
+		cust_printf(fd, ", no limit\n");
+	}
+	for (i = 0; i < SS7_MSG_CLASSES; i++) {
+		cust_printf(fd, "Messages (%i bytes): %i in use, %i high-water, %i spare, %u allocated, %u from malloc\n",
+				ss7_msg_sizes[i], ss7->msg_in_use[i], ss7->msg_hwm[i], ss7->msg_free_len[i],
+				ss7->msg_allocs[i], ss7->msg_mallocs[i]);
+	}
+	cust_printf(fd, "Events: %i pending, %i high-water", ss7->ev_len, ss7->ev_hwm);
+	if (ss7->ev_max) {
+		cust_printf(fd, ", limit %i", ss7->ev_max);
+	} else {
+		cust_printf(fd, ", no limit");
+	}
+	cust_printf(fd, ", %u dropped\n", ss7->ev_dropped);
+	for (i = 0; i < SS7_EVENT_LANES; i++) {
+		cust_printf(fd, "  %s events: %i pending, %i high-water, %i slots, %u queued\n",
+				(i == SS7_EVENT_LANE_MNG) ? "Link" : "Call", ss7->ev_lanes[i].len,
+				ss7->ev_lanes[i].hwm, ss7->ev_lanes[i].size, ss7->ev_lanes[i].queued);
+	}
+	if (ss7->ev_high) {
+		cust_printf(fd, "Links busy: %s, busy at %i, clear at %i, busy %u times\n",
+				ss7->ev_throttled ? "yes" : "no", ss7->ev_high, ss7->ev_low, ss7->ev_throttle_count);
+	}
+	if (ss7->ev_ring) {
+		cust_printf(fd, "Event ring: %u slots, %u events, %u commands\n", ss7->ev_ring->size,
+				__atomic_load_n(&ss7->ev_ring->published, __ATOMIC_RELAXED),
+				__atomic_load_n(&ss7->cmd_ring->published, __ATOMIC_RELAXED));
+	}
 
 
 	for (j = 0; j < ss7->numsps; j++) {
@@ -651,8 +1439,8 @@ void ss7_show_linkset(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd)
 				if (link->mtp3_timer[x] > -1) {
 					strcpy(p, mtp3_timer2str(x));
 					p += strlen(p);
-					sprintf(p, "(%lis)%c", ss7->ss7_sched[ss7->links[i]->mtp3_timer[x]].when.tv_sec - time(NULL),
-						ss7->ss7_sched[ss7->links[i]->mtp3_timer[x]].callback ? ' ' : '!');
+					left = ss7_schedule_ms_left(ss7, ss7->links[i]->mtp3_timer[x]);
+					sprintf(p, "(%is)%c", (left > 0) ? left / 1000 : 0, (left > -1) ? ' ' : '!');
 					p += strlen(p);
 				}
 			}
@@ -665,11 +1453,11 @@ void ss7_show_linkset(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd)
 			cust_printf(fd, "    Inhibit:    %s%s\n", (link->inhibit & INHIBITED_LOCALLY) ? "Locally " : "        ",
 					(ss7->links[i]->inhibit & INHIBITED_REMOTELY) ? "Remotely" : "");
 			cust_printf(fd, "    Changeover: %s\n", changeover2str(link->changeover));
-			cust_printf(fd, "    Tx buffer:  %i\n", len_buf(link->tx_buf));
-			cust_printf(fd, "    Tx queue:   %i\n", len_buf(link->tx_q));
-			cust_printf(fd, "    Retrans pos %i\n", len_buf(link->retransmit_pos));
-			cust_printf(fd, "    CO buffer:  %i\n", len_buf(link->co_buf));
-			cust_printf(fd, "    CB buffer:  %i\n", len_buf(link->cb_buf));
+			cust_printf(fd, "    Tx buffer:  %i\n", mtp2_txbuf_len(link));
+			cust_printf(fd, "    Tx queue:   %i\n", link->tx_q.len);
+			cust_printf(fd, "    Retrans pos %i\n", link->retransmit_pos);
+			cust_printf(fd, "    CO buffer:  %i\n", link->co_buf.len);
+			cust_printf(fd, "    CB buffer:  %i\n", link->cb_buf.len);
 			cust_printf(fd, "    Last FSN:   %i\n", link->lastfsnacked);
 			cust_printf(fd, "    MTP3timers: %s\n", timers);
 		} /* links */
@@ -33,6 +33,7 @@
 #define _SS7_H
 
 #include <sys/time.h>
+#include <time.h>
 #include <stdio.h>
 #include "libss7.h"
 /* #include "mtp2.h" */
@@ -53,8 +54,25 @@
 /* User Information layer 1 protocol types */
 #define ISUP_L1PROT_G711ULAW	0x02
 
-#define MAX_EVENTS			16
-#define MAX_SCHED			512	/* need a lot cause of isup timers... */
+#define SS7_EVENTS_INITIAL	16		/* event queue slots to start with, grows on demand */
+#define SS7_MAX_EVENTS		4096	/* default limit on pending events */
+#define SS7_MAX_EVENT_TYPES	64		/* event handler table size, above the highest *_EVENT_* */
+#define SS7_EVENT_LANE_MNG	0		/* link state events, taken first */
+#define SS7_EVENT_LANE_CALL	1		/* everything for a CIC, in order */
+#define SS7_EVENT_LANES		2
+#define SS7_EVENT_RING_SIZE	1024	/* default slots in the event and command rings */
+#define SS7_MSG_POOL_MAX	256		/* default spare messages of each size kept for reuse */
+#define SS7_TX_BUDGET		32		/* default most SUs written per ss7_write() */
+#define SS7_RX_BUDGET		32		/* default most SUs read per ss7_read() */
+#define SS7_RX_BATCH		16		/* frames per recvmmsg() */
+
+/* Message buffer sizes, MTP2 header and FCS included */
+#define SS7_MSG_CLASS_SMALL	0
+#define SS7_MSG_CLASS_LARGE	1
+#define SS7_MSG_CLASSES		2
+#define SS7_MSG_SMALL		64		/* network management, SLTM, RLC, BLO, GRS, REL... */
+#define SS7_MSG_LARGE		280		/* 3 byte MTP2 header, SIO, 272 byte SIF, FCS */
+#define SS7_SCHED_INITIAL	512	/* scheduler slots to start with, grows on demand */
 #define SS7_MAX_LINKS		8
 #define SS7_MAX_ADJSPS		8
 
@@ -67,6 +85,17 @@
 /* MTP3 timers */
 #define MTP3_MAX_TIMERS		32
 
+/* Timer classes for the scheduler statistics */
+#define SS7_TIMER_OTHER		0
+#define SS7_TIMER_MTP2(t)	(t)								/* MTP2_TIMER_*, 1 - 7 */
+#define SS7_TIMER_MTP3(t)	(8 + (t))						/* MTP3_TIMER_* */
+#define SS7_TIMER_ISUP(t)	(8 + MTP3_MAX_TIMERS + (t))		/* ISUP_TIMER_* */
+#define SS7_TIMER_CLASSES	(8 + MTP3_MAX_TIMERS + ISUP_MAX_TIMERS)
+
+/* Upper bounds (ms) of the timer lateness histogram buckets, plus one for the rest */
+#define SS7_TIMER_LATE_BOUNDS	{ 1, 2, 5, 10, 20, 50, 100, 500 }
+#define SS7_TIMER_LATE_BUCKETS	9
+
 #define LOC_PRIV_NET_LOCAL_USER	0x1
 
 typedef unsigned int point_code;
@@ -79,15 +108,71 @@ struct routing_label {
 };
 
 struct ss7_msg {
-	unsigned char buf[512];
-	unsigned int size;
+	unsigned int size;	/* MTP2 header, SIO and SIF, the FCS is added on write */
+	int msg_class;	/* SS7_MSG_CLASS_* */
+	unsigned char userpart;	/* MTP3 addressing, kept by mtp3_transmit() for rerouting */
+	int priority;
+	struct routing_label rl;
 	struct ss7_msg *next;
+	unsigned char buf[];	/* SS7_MSG_SMALL or SS7_MSG_LARGE bytes */
+};
+
+/* Message queue, linked through ss7_msg->next */
+struct ss7_msgq {
+	struct ss7_msg *head;
+	struct ss7_msg *tail;
+	int len;
 };
 
 struct ss7_sched {
-	struct timeval when;
+	unsigned long long when;	/* CLOCK_MONOTONIC expiry in ns */
+	unsigned long long refresh;	/* later expiry set by ss7_schedule_refresh(), 0 if none */
 	void (*callback)(void *data);
 	void *data;
+	unsigned int seq;	/* scheduling order, breaks ties on equal expiry */
+	unsigned int gen;	/* bumped on every reuse, part of the event id */
+	int timer_class;	/* SS7_TIMER_* */
+	int heap_pos;		/* index in ss7->sched_heap while armed */
+	int next_free;		/* free list link while not armed */
+};
+
+/* Single producer, single consumer ring between the I/O thread and the call
+ * thread.  What each side writes lives on its own cache line. */
+struct ss7_ring {
+	unsigned int head __attribute__((aligned(64)));	/* next slot to fill, producer only */
+	unsigned int published;	/* slots handed over, written by the producer only */
+	unsigned int tail __attribute__((aligned(64)));	/* next slot to take, consumer only */
+	int taken;		/* consumer still holds the slot at tail */
+	int stalled __attribute__((aligned(64)));	/* producer found the ring full */
+	unsigned int size;	/* power of two */
+	int fd;			/* eventfd, readable while there is something to take */
+	int wake_fd;	/* poked when a stalled producer has room again, -1 if none */
+	void *slots;
+};
+
+struct ss7_command {
+	ss7_command_fn fn;
+	void *data;
+};
+
+/* One priority class of the event queue */
+struct ss7_evq {
+	int h;
+	int len;
+	ss7_event *q;	/* ring of size events */
+	ss7_event *q_old;	/* ring before the last grow, the events last handed out may still be in it */
+	int out;		/* slots behind h still held by the application */
+	int size;
+	int hwm;		/* most events ever pending at once */
+	unsigned int queued;	/* events ever queued */
+};
+
+struct ss7_timer_stats {
+	unsigned int started;
+	unsigned int cancelled;
+	unsigned int expired;
+	unsigned int late[SS7_TIMER_LATE_BUCKETS];	/* expiries by how late they ran */
+	unsigned int max_late;	/* ms */
 };
 
 struct ss7 {
@@ -104,14 +189,57 @@ struct ss7 {
 
 	unsigned int debug;
 	/* event queue */
-	int ev_h;
-	int ev_t;
-	int ev_len;
-	ss7_event ev_q[MAX_EVENTS];
-
-	struct ss7_sched ss7_sched[MAX_SCHED];
+	struct ss7_evq ev_lanes[SS7_EVENT_LANES];	/* taken from in order, SS7_EVENT_LANE_* */
+	int ev_len;		/* pending in all lanes */
+	int ev_max;		/* most events pending at once, 0 for no limit */
+	int ev_hwm;		/* most events ever pending at once */
+	unsigned int ev_dropped;	/* events lost to a full queue */
+	int ev_high;		/* backlog that makes the links busy, 0 to never */
+	int ev_low;			/* backlog that clears it */
+	int ev_throttled;	/* links are sending SIB for now */
+	unsigned int ev_throttle_count;	/* times the links went busy */
+	struct {
+		ss7_event_handler fn;
+		void *data;
+	} ev_handler[SS7_MAX_EVENT_TYPES];
+	int ev_dispatching;	/* inside ss7_dispatch_events() */
+	ss7_event *ev_disp_ring;	/* ring the event being handled is in */
+	ss7_event *ev_q_disp;	/* that ring, if it was replaced while the handler ran */
+	struct ss7_ring *ev_ring;	/* events for the call thread, see ss7_set_event_ring() */
+	struct ss7_ring *cmd_ring;	/* commands from the call thread */
+
+	struct ss7_sched *ss7_sched;
+	int *sched_heap;	/* armed slots, min-heap on expiry */
+	int sched_size;		/* allocated slots in ss7_sched and sched_heap */
+	int sched_max;		/* most timers allowed armed at once, 0 for no limit */
+	int sched_hwm;		/* most timers ever armed at once */
+	int sched_len;
+	int sched_free;		/* head of the free slot list, 0 if empty */
+	int sched_top;		/* highest slot ever handed out */
+	unsigned int sched_seq;
+	unsigned long long sched_now;	/* clock cached by ss7_clock_tick() until ss7_schedule_run() */
+	int sched_now_cached;
+	struct timeval sched_next_tv;	/* returned by ss7_schedule_next() */
+	int sched_running;	/* inside ss7_schedule_run() */
+	int sched_timerfd;	/* from ss7_get_timer_fd(), -1 if not used */
+	unsigned long long sched_timerfd_when;	/* deadline sched_timerfd is armed for, 0 if none */
+	int timer_slack[SS7_TIMER_CLASSES];	/* ms a timer may be delayed to share a wakeup */
+	struct ss7_timer_stats *timer_stats;	/* SS7_TIMER_CLASSES entries, NULL unless enabled */
+	unsigned long long timer_stats_since;
 	struct isup_call *calls;
 
+	/* message pool, one per SS7_MSG_CLASS_* */
+	struct ss7_msg *msg_free[SS7_MSG_CLASSES];	/* spare messages, linked through next */
+	int msg_free_len[SS7_MSG_CLASSES];
+	int msg_pool_max;	/* most spare messages kept of each size, 0 to always free() */
+	int msg_in_use[SS7_MSG_CLASSES];
+	int msg_hwm[SS7_MSG_CLASSES];	/* most messages ever in use at once */
+	unsigned int msg_allocs[SS7_MSG_CLASSES];	/* ss7_msg_new() calls */
+	unsigned int msg_mallocs[SS7_MSG_CLASSES];	/* of those, how many had to malloc() */
+
+	int tx_budget;	/* most SUs a ss7_write() sends */
+	int rx_budget;	/* most SUs a ss7_read() takes */
+
 	unsigned int mtp2_linkstate[SS7_MAX_LINKS];
 	struct mtp2 *links[SS7_MAX_LINKS];
 	struct adjacent_sp *adj_sps[SS7_MAX_ADJSPS];
@@ -120,21 +248,42 @@ struct ss7 {
 	unsigned char sls_shift;
 	unsigned int flags;
 	unsigned char cb_seq;
-	int linkset_up_timer;
+	long long linkset_up_timer;
 	unsigned char cause_location;
 };
 
-/* Getto hacks for developmental purposes */
-struct ss7_msg * ss7_msg_new(void);
+/* Message buffers, from the per-instance pool.  len is the most the user
+ * part (routing label onwards) can take, it picks the buffer size. */
+struct ss7_msg * ss7_msg_new(struct ss7 *ss7, int len);
+
+void ss7_msg_free(struct ss7 *ss7, struct ss7_msg *m);
+
+void ss7_msgq_add(struct ss7_msgq *q, struct ss7_msg *m);
 
-void ss7_msg_free(struct ss7_msg *m);
+struct ss7_msg * ss7_msgq_pop(struct ss7_msgq *q);
 
-/* Scheduler functions */
-int ss7_schedule_event(struct ss7 *ss7, int ms, void (*function)(void *data), void *data);
+void ss7_msgq_flush(struct ss7 *ss7, struct ss7_msgq *q);
 
-ss7_event * ss7_next_empty_event(struct ss7 * ss7);
+/* Scheduler functions.  Event ids are positive, -1 means no event. */
+long long ss7_schedule_event(struct ss7 *ss7, int timer_class, int ms, void (*function)(void *data), void *data);
 
-void ss7_schedule_del(struct ss7 *ss7,int *id);
+/* Queue an event of the given *_EVENT_* type, NULL if the queue is full */
+ss7_event * ss7_next_empty_event(struct ss7 * ss7, int type);
+
+/* Hand queued events to their handlers, see ss7_set_event_handler() */
+void ss7_dispatch_events(struct ss7 *ss7);
+
+void ss7_schedule_del(struct ss7 *ss7, long long *id);
+
+/* Move the expiry of the armed event id to ms from now, -1 if it is not armed */
+int ss7_schedule_refresh(struct ss7 *ss7, long long id, int ms);
+
+/* Milliseconds until the event id expires, 0 if it is already due and -1 if
+ * it is not armed */
+int ss7_schedule_ms_left(struct ss7 *ss7, long long id);
+
+/* The data the event id was armed with, NULL if it is not armed */
+void *ss7_schedule_data(struct ss7 *ss7, long long id);
 
 int ss7_find_link_index(struct ss7 *ss7, int fd);
 
@@ -144,6 +293,9 @@ unsigned char *ss7_msg_userpart(struct ss7_msg *m);
 
 void ss7_msg_userpart_len(struct ss7_msg *m, int len);
 
+/* Room for the user part in m */
+int ss7_msg_userpart_max(struct ss7_msg *m);
+
 void ss7_message(struct ss7 *ss7, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 void ss7_error(struct ss7 *ss7, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 
@@ -31,67 +31,418 @@
 
 #include "libss7.h"
 #include "ss7_internal.h"
+#include "mtp2.h"
 #include "mtp3.h"
+#include "isup.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
 
 
-/* Scheduler routines */
-int ss7_schedule_event(struct ss7 *ss7, int ms, void (*function)(void *data), void *data)
+/* Scheduler routines
+ *
+ * Armed events are kept in a binary min-heap (ss7->sched_heap) of slot
+ * numbers ordered by expiry, so arming, deleting and running an event are
+ * O(log n) and finding the next one is O(1).  Slots do not move while armed.
+ * The slot array is grown on demand.  No more than ss7->sched_max timers are
+ * armed at once if a limit is set, whenever it was set.
+ *
+ * The 64-bit id handed back to the rest of the stack packs the slot number
+ * with the slot's 31-bit generation, which changes every time the slot is
+ * reused.  An id for an event that already ran or was deleted does not match
+ * whatever the slot holds now until that one slot has been reused 2^31 times,
+ * so deleting or looking it up is a harmless no-op.
+ *
+ * Expiry times are CLOCK_MONOTONIC nanoseconds, so stepping the wall clock
+ * does not move them.  ss7_clock_tick() reads the clock once for a pass of
+ * the application's event loop, and that time is used as "now" for every
+ * event armed or run until ss7_read(), ss7_write(), ss7_schedule_run() or a
+ * drained ss7_check_event(s)() ends the pass.  An application that ticks but
+ * seldom runs the scheduler therefore doesn't keep arming timers from an old
+ * time.
+ * Outside a pass, e.g. for isup_*() calls made from another thread, the clock
+ * is read live.
+ */
+
+#ifdef __linux__
+/* Make sure the timer fd, if the application asked for one, wakes it up no
+ * later than the earliest armed event.  A deadline that is already set and
+ * not later than that is left alone: waking up early for an event that has
+ * since been deleted only costs an empty ss7_schedule_run(). */
+static void sched_timerfd_arm(struct ss7 *ss7)
 {
-	int x;
-	struct timeval tv;
-	for (x=1;x<MAX_SCHED;x++)
-		if (!ss7->ss7_sched[x].callback)
+	struct itimerspec its;
+	unsigned long long when;
+
+	if (ss7->sched_timerfd < 0 || ss7->sched_running || !ss7->sched_len)
+		return;
+
+	when = ss7->ss7_sched[ss7->sched_heap[0]].when;
+	if (ss7->sched_timerfd_when && ss7->sched_timerfd_when <= when)
+		return;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = when / 1000000000ULL;
+	its.it_value.tv_nsec = when % 1000000000ULL;
+	if (timerfd_settime(ss7->sched_timerfd, TFD_TIMER_ABSTIME, &its, NULL)) {
+		ss7_error(ss7, "Unable to arm timer fd: %s\n", strerror(errno));
+		return;
+	}
+	ss7->sched_timerfd_when = when;
+}
+
+/* Called before running events: acknowledge the expiry if the fd fired */
+static void sched_timerfd_drain(struct ss7 *ss7)
+{
+	unsigned long long expirations;
+
+	if (ss7->sched_timerfd < 0)
+		return;
+
+	if (read(ss7->sched_timerfd, &expirations, sizeof(expirations)) == sizeof(expirations))
+		ss7->sched_timerfd_when = 0;
+}
+#else
+static inline void sched_timerfd_arm(struct ss7 *ss7)
+{
+}
+
+static inline void sched_timerfd_drain(struct ss7 *ss7)
+{
+}
+#endif
+
+int ss7_get_timer_fd(struct ss7 *ss7)
+{
+#ifdef __linux__
+	int fd;
+
+	if (ss7->sched_timerfd > -1)
+		return ss7->sched_timerfd;
+
+	if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+		ss7_error(ss7, "Unable to create timer fd: %s\n", strerror(errno));
+		return -1;
+	}
+	ss7->sched_timerfd = fd;
+	ss7->sched_timerfd_when = 0;
+	sched_timerfd_arm(ss7);
+
+	return fd;
+#else
+	ss7_error(ss7, "Timer fd is not supported on this platform\n");
+	return -1;
+#endif
+}
+
+static unsigned long long sched_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline unsigned long long sched_now(struct ss7 *ss7)
+{
+	return ss7->sched_now_cached ? ss7->sched_now : sched_clock();
+}
+
+void ss7_clock_tick(struct ss7 *ss7)
+{
+	ss7->sched_now = sched_clock();
+	ss7->sched_now_cached = 1;
+}
+
+#define SCHED_MAX_SLOTS		(1 << 20)
+#define SCHED_SLOT_BITS		32
+#define SCHED_SLOT_MASK		0xffffffffLL
+#define SCHED_GEN_MASK		0x7fffffffU		/* keeps ids positive */
+
+/* Slot of the armed event id, or 0 if the id is not (or no longer) armed */
+static inline int sched_slot(struct ss7 *ss7, long long id)
+{
+	long long x = id & SCHED_SLOT_MASK;
+
+	if (id <= 0 || x >= ss7->sched_size || !ss7->ss7_sched[x].callback ||
+		ss7->ss7_sched[x].gen != (id >> SCHED_SLOT_BITS))
+		return 0;
+	return (int) x;
+}
+
+static inline int sched_before(struct ss7_sched *a, struct ss7_sched *b)
+{
+	if (a->when != b->when)
+		return a->when < b->when;
+	/* Same expiry, keep the order they were scheduled in */
+	return (int)(a->seq - b->seq) < 0;
+}
+
+static inline void sched_heap_set(struct ss7 *ss7, int pos, int x)
+{
+	ss7->sched_heap[pos] = x;
+	ss7->ss7_sched[x].heap_pos = pos;
+}
+
+static void sched_heap_up(struct ss7 *ss7, int pos)
+{
+	int x = ss7->sched_heap[pos];
+	int parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (!sched_before(&ss7->ss7_sched[x], &ss7->ss7_sched[ss7->sched_heap[parent]]))
 			break;
-	if (x == MAX_SCHED) {
+		sched_heap_set(ss7, pos, ss7->sched_heap[parent]);
+		pos = parent;
+	}
+	sched_heap_set(ss7, pos, x);
+}
+
+static void sched_heap_down(struct ss7 *ss7, int pos)
+{
+	int x = ss7->sched_heap[pos];
+	int child;
+
+	while ((child = 2 * pos + 1) < ss7->sched_len) {
+		if (child + 1 < ss7->sched_len &&
+			sched_before(&ss7->ss7_sched[ss7->sched_heap[child + 1]], &ss7->ss7_sched[ss7->sched_heap[child]]))
+			child++;
+		if (!sched_before(&ss7->ss7_sched[ss7->sched_heap[child]], &ss7->ss7_sched[x]))
+			break;
+		sched_heap_set(ss7, pos, ss7->sched_heap[child]);
+		pos = child;
+	}
+	sched_heap_set(ss7, pos, x);
+}
+
+/* Take slot x out of the heap and put it on the free list */
+static void sched_release(struct ss7 *ss7, int x)
+{
+	int pos = ss7->ss7_sched[x].heap_pos;
+	int last = ss7->sched_heap[--ss7->sched_len];
+
+	if (last != x) {
+		sched_heap_set(ss7, pos, last);
+		if (pos > 0 && sched_before(&ss7->ss7_sched[last], &ss7->ss7_sched[ss7->sched_heap[(pos - 1) / 2]]))
+			sched_heap_up(ss7, pos);
+		else
+			sched_heap_down(ss7, pos);
+	}
+
+	ss7->ss7_sched[x].callback = NULL;
+	ss7->ss7_sched[x].data = NULL;
+	ss7->ss7_sched[x].next_free = ss7->sched_free;
+	ss7->sched_free = x;
+}
+
+static int sched_grow(struct ss7 *ss7)
+{
+	int size = ss7->sched_size ? ss7->sched_size * 2 : SS7_SCHED_INITIAL;
+	struct ss7_sched *sched;
+	int *heap;
+
+	/* Slot 0 is reserved, so sched_max timers need sched_max + 1 slots */
+	if (ss7->sched_max && size > ss7->sched_max + 1)
+		size = ss7->sched_max + 1;
+	if (size > SCHED_MAX_SLOTS)
+		size = SCHED_MAX_SLOTS;
+	if (size <= ss7->sched_size)
+		return -1;
+
+	if (!(sched = realloc(ss7->ss7_sched, size * sizeof(*sched))))
+		return -1;
+	ss7->ss7_sched = sched;
+	memset(&sched[ss7->sched_size], 0, (size - ss7->sched_size) * sizeof(*sched));
+
+	if (!(heap = realloc(ss7->sched_heap, size * sizeof(*heap))))
+		return -1;
+	ss7->sched_heap = heap;
+	ss7->sched_size = size;
+
+	return 0;
+}
+
+static unsigned long long sched_deadline(struct ss7 *ss7, int timer_class, int ms)
+{
+	unsigned long long when, slack;
+
+	when = sched_now(ss7) + (unsigned long long) ms * 1000000ULL;
+	/* Round up to a multiple of the slack, so that timers of the same kind
+	 * armed close together expire together.  Never earlier than asked. */
+	if (ss7->timer_slack[timer_class] > 0) {
+		slack = (unsigned long long) ss7->timer_slack[timer_class] * 1000000ULL;
+		when = (when + slack - 1) / slack * slack;
+	}
+	return when;
+}
+
+long long ss7_schedule_event(struct ss7 *ss7, int timer_class, int ms, void (*function)(void *data), void *data)
+{
+	int x;
+
+	/* The limit may have been lowered after the array grew past it */
+	if (ss7->sched_max && ss7->sched_len >= ss7->sched_max) {
 		ss7_error(ss7, "No more room in scheduler\n");
 		return -1;
 	}
-	gettimeofday(&tv, NULL);
-	tv.tv_sec += ms / 1000;
-	tv.tv_usec += (ms % 1000) * 1000;
-	if (tv.tv_usec > 1000000) {
-		tv.tv_usec -= 1000000;
-		tv.tv_sec += 1;
+
+	/* Slot 0 is never handed out, so a free list head of 0 means empty */
+	if (ss7->sched_free) {
+		x = ss7->sched_free;
+		ss7->sched_free = ss7->ss7_sched[x].next_free;
+	} else if (ss7->sched_top < ss7->sched_size - 1 || !sched_grow(ss7)) {
+		x = ++ss7->sched_top;
+	} else {
+		ss7_error(ss7, "No more room in scheduler\n");
+		return -1;
 	}
-	ss7->ss7_sched[x].when = tv;
+	ss7->ss7_sched[x].when = sched_deadline(ss7, timer_class, ms);
+	ss7->ss7_sched[x].refresh = 0;
 	ss7->ss7_sched[x].callback = function;
 	ss7->ss7_sched[x].data = data;
-	return x;
+	ss7->ss7_sched[x].seq = ss7->sched_seq++;
+	ss7->ss7_sched[x].timer_class = timer_class;
+	ss7->ss7_sched[x].gen = (ss7->ss7_sched[x].gen + 1) & SCHED_GEN_MASK;
+	if (!ss7->ss7_sched[x].gen)
+		ss7->ss7_sched[x].gen = 1;
+	ss7->sched_heap[ss7->sched_len] = x;
+	sched_heap_up(ss7, ss7->sched_len++);
+	if (ss7->sched_len > ss7->sched_hwm)
+		ss7->sched_hwm = ss7->sched_len;
+	if (ss7->timer_stats)
+		ss7->timer_stats[timer_class].started++;
+	sched_timerfd_arm(ss7);
+	return ((long long) ss7->ss7_sched[x].gen << SCHED_SLOT_BITS) | x;
+}
+
+/* Push the expiry of an armed event out to ms from now without touching the
+ * heap.  The event stays where it is and, when its original expiry comes,
+ * goes back into the heap at the new deadline instead of firing.  Meant for
+ * timers that are restarted far more often than they expire, like MTP2 T7. */
+int ss7_schedule_refresh(struct ss7 *ss7, long long id, int ms)
+{
+	int x = sched_slot(ss7, id);
+
+	if (!x)
+		return -1;
+	ss7->ss7_sched[x].refresh = sched_deadline(ss7, ss7->ss7_sched[x].timer_class, ms);
+	return 0;
 }
 
+/* Nanoseconds from now until the armed event x expires, 0 if already due */
+static unsigned long long sched_left(struct ss7 *ss7, int x, unsigned long long now)
+{
+	unsigned long long when = ss7->ss7_sched[x].when;
+
+	if (ss7->ss7_sched[x].refresh > when)
+		when = ss7->ss7_sched[x].refresh;
+	if (when <= now)
+		return 0;
+	return when - now;
+}
+
+/* The closest event as a gettimeofday() time, kept for older applications */
 struct timeval *ss7_schedule_next(struct ss7 *ss7)
 {
-	struct timeval *closest = NULL;
-	int x;
-	/* Check subchannels */
-	for (x=1;x<MAX_SCHED;x++) {
-		if (ss7->ss7_sched[x].callback && 
-			(!closest || (closest->tv_sec > ss7->ss7_sched[x].when.tv_sec) ||
-				((closest->tv_sec == ss7->ss7_sched[x].when.tv_sec) && 
-				 (closest->tv_usec > ss7->ss7_sched[x].when.tv_usec))))
-				 	closest = &ss7->ss7_sched[x].when;
+	unsigned long long left;
+	struct timeval *tv = &ss7->sched_next_tv;
+
+	if (!ss7->sched_len)
+		return NULL;
+
+	left = sched_left(ss7, ss7->sched_heap[0], sched_clock()) / 1000;
+	gettimeofday(tv, NULL);
+	tv->tv_sec += left / 1000000;
+	tv->tv_usec += left % 1000000;
+	if (tv->tv_usec >= 1000000) {
+		tv->tv_usec -= 1000000;
+		tv->tv_sec += 1;
 	}
-	return closest;
+	return tv;
 }
 
-static int __ss7_schedule_run(struct ss7 *ss7, struct timeval *tv)
+int ss7_schedule_next_ms(struct ss7 *ss7)
+{
+	if (!ss7->sched_len)
+		return -1;
+
+	/* Round up so a poll() with this timeout never wakes before expiry */
+	return (sched_left(ss7, ss7->sched_heap[0], sched_clock()) + 999999) / 1000000;
+}
+
+int ss7_schedule_ms_left(struct ss7 *ss7, long long id)
+{
+	int x = sched_slot(ss7, id);
+
+	if (!x)
+		return -1;
+	return sched_left(ss7, x, sched_now(ss7)) / 1000000;
+}
+
+void *ss7_schedule_data(struct ss7 *ss7, long long id)
+{
+	int x = sched_slot(ss7, id);
+
+	if (!x)
+		return NULL;
+	return ss7->ss7_sched[x].data;
+}
+
+static void timer_stats_expired(struct ss7 *ss7, int x, unsigned long long now)
+{
+	static const unsigned int bounds[] = SS7_TIMER_LATE_BOUNDS;
+	struct ss7_timer_stats *stats = &ss7->timer_stats[ss7->ss7_sched[x].timer_class];
+	unsigned int late = (now - ss7->ss7_sched[x].when) / 1000000;
+	int i;
+
+	for (i = 0; i < SS7_TIMER_LATE_BUCKETS - 1 && late >= bounds[i]; i++);
+	stats->late[i]++;
+	if (late > stats->max_late)
+		stats->max_late = late;
+	stats->expired++;
+}
+
+static int __ss7_schedule_run(struct ss7 *ss7, unsigned long long now)
 {
 	int x;
 	void (*callback)(void *);
 	void *data;
-	for (x=1;x<MAX_SCHED;x++) {
-		if (ss7->ss7_sched[x].callback &&
-			((ss7->ss7_sched[x].when.tv_sec < tv->tv_sec) ||
-			 ((ss7->ss7_sched[x].when.tv_sec == tv->tv_sec) &&
-			  (ss7->ss7_sched[x].when.tv_usec <= tv->tv_usec)))) {
-			  	callback = ss7->ss7_sched[x].callback;
-				data = ss7->ss7_sched[x].data;
-				ss7->ss7_sched[x].callback = NULL;
-				ss7->ss7_sched[x].data = NULL;
-				callback(data);
+	unsigned int seq = ss7->sched_seq;
+
+	sched_timerfd_drain(ss7);
+	ss7->sched_running = 1;
+
+	while (ss7->sched_len) {
+		x = ss7->sched_heap[0];
+		if (ss7->ss7_sched[x].when > now)
+			break;
+		/* Events armed by a callback in this pass wait for the next one */
+		if ((int)(ss7->ss7_sched[x].seq - seq) >= 0)
+			break;
+		/* Refreshed since it was armed, requeue at the new deadline */
+		if (ss7->ss7_sched[x].refresh > ss7->ss7_sched[x].when) {
+			ss7->ss7_sched[x].when = ss7->ss7_sched[x].refresh;
+			ss7->ss7_sched[x].refresh = 0;
+			sched_heap_down(ss7, 0);
+			continue;
 		}
+		if (ss7->timer_stats)
+			timer_stats_expired(ss7, x, now);
+		callback = ss7->ss7_sched[x].callback;
+		data = ss7->ss7_sched[x].data;
+		sched_release(ss7, x);
+		callback(data);
 	}
+
+	ss7->sched_running = 0;
+	sched_timerfd_arm(ss7);
+	ss7_dispatch_events(ss7);
 	return 0;
 }
 
@@ -99,22 +450,118 @@ int ss7_schedule_run(struct ss7 *ss7)
 {
 	int res;
 
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-
-	res =  __ss7_schedule_run(ss7, &tv);
+	res =  __ss7_schedule_run(ss7, sched_now(ss7));
+	/* End of the pass, don't arm later timers from a stale time */
+	ss7->sched_now_cached = 0;
 
 	return res;
 }
 
-void ss7_schedule_del(struct ss7 *ss7, int *id)
+void ss7_schedule_del(struct ss7 *ss7, long long *id)
 {
-	if ((*id >= MAX_SCHED)) 
-		ss7_error(ss7, "Asked to delete sched id %d???\n", *id);
+	int x;
 
 	if (*id < 0) /* Item already deleted */
 		return;
 
-	ss7->ss7_sched[*id].callback = NULL;
+	/* Already ran, or the slot has been reused since */
+	if ((x = sched_slot(ss7, *id))) {
+		if (ss7->timer_stats)
+			ss7->timer_stats[ss7->ss7_sched[x].timer_class].cancelled++;
+		sched_release(ss7, x);
+	}
 	*id = -1; /* "Delete" the event */
 }
+
+void ss7_set_max_timers(struct ss7 *ss7, int max)
+{
+	if (!ss7 || max < 0) {
+		return;
+	}
+
+	ss7->sched_max = max;
+}
+
+void ss7_set_timer_stats(struct ss7 *ss7, int enable)
+{
+	if (!ss7) {
+		return;
+	}
+
+	if (!enable) {
+		free(ss7->timer_stats);
+		ss7->timer_stats = NULL;
+	} else if (!ss7->timer_stats) {
+		if (!(ss7->timer_stats = calloc(SS7_TIMER_CLASSES, sizeof(*ss7->timer_stats)))) {
+			ss7_error(ss7, "Unable to allocate timer statistics\n");
+			return;
+		}
+		ss7->timer_stats_since = sched_clock();
+	}
+}
+
+void ss7_reset_timer_stats(struct ss7 *ss7)
+{
+	if (!ss7 || !ss7->timer_stats) {
+		return;
+	}
+
+	memset(ss7->timer_stats, 0, SS7_TIMER_CLASSES * sizeof(*ss7->timer_stats));
+	ss7->timer_stats_since = sched_clock();
+}
+
+static const char *timer_class2str(int timer_class, char *buf)
+{
+	if (timer_class >= SS7_TIMER_ISUP(0)) {
+		sprintf(buf, "ISUP %s", isup_timer2str(timer_class - SS7_TIMER_ISUP(0)));
+	} else if (timer_class >= SS7_TIMER_MTP3(0)) {
+		sprintf(buf, "MTP3 %s", mtp3_timer2str(timer_class - SS7_TIMER_MTP3(0)));
+	} else if (timer_class > SS7_TIMER_OTHER) {
+		sprintf(buf, "MTP2 %s", mtp2_timer2str(timer_class - SS7_TIMER_MTP2(0)));
+	} else {
+		strcpy(buf, "Other");
+	}
+	return buf;
+}
+
+void ss7_show_timer_stats(struct ss7 *ss7, ss7_printf_cb cust_printf, int fd)
+{
+	static const unsigned int bounds[] = SS7_TIMER_LATE_BOUNDS;
+	struct ss7_timer_stats *stats;
+	unsigned long long secs;
+	char name[64];
+	int x, i;
+
+	if (!ss7->timer_stats) {
+		cust_printf(fd, "Timer statistics are not enabled\n");
+		return;
+	}
+
+	secs = (sched_clock() - ss7->timer_stats_since) / 1000000000ULL;
+	cust_printf(fd, "Timer statistics for the last %llus\n", secs);
+	if (!secs) {
+		secs = 1;
+	}
+
+	cust_printf(fd, "%-14s %10s %10s %10s %8s  Expired by lateness (ms)\n", "Timer", "Started", "Cancelled", "Expired", "Max late");
+	cust_printf(fd, "%-14s %10s %10s %10s %8s ", "", "", "", "", "");
+	for (i = 0; i < SS7_TIMER_LATE_BUCKETS - 1; i++) {
+		cust_printf(fd, " <%-5u", bounds[i]);
+	}
+	cust_printf(fd, " >=%u\n", bounds[SS7_TIMER_LATE_BUCKETS - 2]);
+
+	for (x = 0; x < SS7_TIMER_CLASSES; x++) {
+		stats = &ss7->timer_stats[x];
+		if (!stats->started && !stats->expired && !stats->cancelled) {
+			continue;
+		}
+		cust_printf(fd, "%-14s %10u %10u %10u %8u ", timer_class2str(x, name), stats->started, stats->cancelled,
+				stats->expired, stats->max_late);
+		for (i = 0; i < SS7_TIMER_LATE_BUCKETS; i++) {
+			cust_printf(fd, " %-6u", stats->late[i]);
+		}
+		cust_printf(fd, "\n");
+		cust_printf(fd, "%-14s %9llu/s %9llu/s %9llu/s\n", "", stats->started / secs, stats->cancelled / secs,
+				stats->expired / secs);
+	}
+}
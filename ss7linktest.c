@@ -74,7 +74,6 @@ static void ss7_call(struct ss7 *ss7)
 static void *ss7_run(void *data)
 {
 	int res = 0;
-	struct timeval *next = NULL, tv;
 	struct linkset *linkset = (struct linkset *) data;
 	struct ss7 *ss7 = linkset->ss7;
 	ss7_event *e = NULL;
@@ -93,35 +92,14 @@ static void *ss7_run(void *data)
 	ss7_start(ss7);
 
 	while (1) {
-		if ((next = ss7_schedule_next(ss7))) {
-			gettimeofday(&tv, NULL);
-			tv.tv_sec = next->tv_sec - tv.tv_sec;
-			tv.tv_usec = next->tv_usec - tv.tv_usec;
-			if (tv.tv_usec < 0) {
-				tv.tv_usec += 1000000;
-				tv.tv_sec -= 1;
-			}
-			if (tv.tv_sec < 0) {
-				tv.tv_sec = 0;
-				tv.tv_usec = 0;
-			}
-			nextms = tv.tv_sec * 1000;
-			nextms += tv.tv_usec / 1000;
-		} else {
-			nextms = -1;
-		}
+		nextms = ss7_schedule_next_ms(ss7);
 		poller.fd = linkset->fd;
 		poller.events = ss7_pollflags(ss7, linkset->fd);
 		poller.revents = 0;
 
 		res = poll(&poller, 1, nextms);
+		ss7_clock_tick(ss7);
 		if (res < 0) {
-#if 0
-			printf("next->tv_sec = %d\n", (int) next->tv_sec);
-			printf("next->tv_usec = %d\n", (int) next->tv_usec);
-			printf("tv->tv_sec = %d\n", (int) tv.tv_sec);
-			printf("tv->tv_usec = %d\n", (int) tv.tv_usec);
-#endif
 			perror("select");
 		} else if (!res) {
 			ss7_schedule_run(ss7);
@@ -223,6 +201,9 @@ static void *ss7_run(void *data)
 				}
 			}
 		}
+
+		/* Also ends the pass started by ss7_clock_tick() */
+		ss7_schedule_run(ss7);
 	}
 
 	return NULL;
@@ -0,0 +1,85 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Changeover backlog: buffer N ISUP MSUs in co_buf of a link whose
+ * changeover has started, then time mtp3_changeover() moving them onto the
+ * other link of the linkset.  mtp3.c is compiled in to reach the static
+ * changeover code; the archive's copy is never pulled in.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include "../mtp3.c"
+#include <time.h>
+
+#define ROUNDS	5
+
+static void quiet(struct ss7 *ss7, char *s)
+{
+}
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void bench(int n)
+{
+	struct routing_label rl = { SS7_ITU, 2, 1, 0 };
+	long long enqueue = 0, drain = 0, t0, t1, t2;
+	struct ss7 *ss7;
+	struct mtp2 *l0, *l1;
+	struct ss7_msg *m;
+	int i, r, moved = 0;
+
+	for (r = 0; r < ROUNDS; r++) {
+		ss7 = ss7_new(SS7_ITU);
+		ss7_set_pc(ss7, 1);
+		ss7_add_link(ss7, SS7_TRANSPORT_DAHDIDCHAN, -1, 0, 2);
+		ss7_add_link(ss7, SS7_TRANSPORT_DAHDIDCHAN, -1, 1, 2);
+		l0 = ss7->links[0];
+		l1 = ss7->links[1];
+		ss7->mtp2_linkstate[0] = ss7->mtp2_linkstate[1] = MTP2_LINKSTATE_UP;
+		l0->adj_sp->state = MTP3_UP;
+		l0->state = l1->state = MTP_INSERVICE;
+		/* Everything sent on link 0 now goes to co_buf */
+		l0->changeover = CHANGEOVER_INITIATED;
+
+		t0 = now_us();
+		for (i = 0; i < n; i++) {
+			m = ss7_msg_new(ss7, 20);
+			set_routinglabel(ss7_msg_userpart(m), &rl);
+			ss7_msg_userpart_len(m, 20);
+			mtp3_transmit(ss7, SIG_ISUP, rl, 0, m, NULL);
+		}
+		t1 = now_us();
+		ss7->mtp2_linkstate[0] = MTP2_LINKSTATE_DOWN;
+		mtp3_changeover(l0, 0);
+		t2 = now_us();
+
+		enqueue += t1 - t0;
+		drain += t2 - t1;
+		moved = l1->tx_q.len;
+		flush_bufs(l0);
+		flush_bufs(l1);
+		ss7_destroy(ss7);
+	}
+
+	printf("N=%-6d enqueue %8.2f ms, drain %8.2f ms (%d moved, average of %d)\n",
+		n, enqueue / 1000.0 / ROUNDS, drain / 1000.0 / ROUNDS, moved, ROUNDS);
+}
+
+int main(void)
+{
+	ss7_set_message(quiet);
+	ss7_set_error(quiet);
+	bench(1000);
+	bench(10000);
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * IAMs with every optional number at full length must be refused without
+ * writing past the message buffer, ones that fit must arrive intact.  Build
+ * with -fsanitize=address to catch an overflow the checks miss.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include "loopback.h"
+#include "../isup.h"
+
+static char longnum[ISUP_MAX_NUM];	/* longest a call holds */
+static char evnum[sizeof(((ss7_event_iam *) 0)->called_party_num)];	/* longest an event carries */
+static int got_iam;
+static char got_called[ISUP_MAX_NUM], got_calling[ISUP_MAX_NUM], got_charge[ISUP_MAX_NUM];
+
+static void iam_event(struct loopback *lb, int side, ss7_event *e)
+{
+	if (side == 1 && e->e == ISUP_EVENT_IAM) {
+		got_iam++;
+		snprintf(got_called, sizeof(got_called), "%s", e->iam.called_party_num);
+		snprintf(got_calling, sizeof(got_calling), "%s", e->iam.calling_party_num);
+		snprintf(got_charge, sizeof(got_charge), "%s", e->iam.charge_number);
+	}
+}
+
+static struct isup_call *long_call(struct ss7 *ss7, int cic, const char *num)
+{
+	struct isup_call *c = isup_new_call(ss7, cic, 2, 0);
+
+	if (c) {
+		isup_set_called(c, num, SS7_NAI_NATIONAL, ss7);
+		isup_set_calling(c, num, SS7_NAI_NATIONAL, SS7_PRESENTATION_ALLOWED, SS7_SCREENING_USER_PROVIDED);
+		isup_set_charge(c, num, SS7_ANI_CALLING_PARTY_SUB_NUMBER, 1);
+	}
+
+	return c;
+}
+
+int main(void)
+{
+	struct loopback lb;
+	struct isup_call *c;
+	unsigned int queued;
+	int i, failed = 0;
+
+	for (i = 0; i < ISUP_MAX_NUM - 1; i++) {
+		longnum[i] = '0' + (i % 10);
+	}
+	memcpy(evnum, longnum, sizeof(evnum) - 1);
+
+	if (lb_init(&lb, SS7_ANSI)) {
+		printf("FAIL: link did not come up\n");
+		return 1;
+	}
+	ss7_set_msg_pool(lb.ss7[0], 0, 0);	/* plain malloc()ed buffers for the sanitizers */
+	lb.event = iam_event;
+
+	/* Every number-carrying parameter at full length is far over the SIF */
+	c = long_call(lb.ss7[0], 1, longnum);
+	isup_set_redirecting_number(c, longnum, SS7_NAI_NATIONAL, SS7_PRESENTATION_ALLOWED, SS7_SCREENING_USER_PROVIDED);
+	isup_set_orig_called_num(c, longnum, SS7_NAI_NATIONAL, SS7_PRESENTATION_ALLOWED, SS7_SCREENING_USER_PROVIDED);
+	isup_set_gen_address(c, longnum, SS7_NAI_NATIONAL, SS7_PRESENTATION_ALLOWED, 1, 0);
+	isup_set_gen_digits(c, longnum, 0, 0);
+	isup_set_jip_digits(c, longnum);
+	isup_set_lspi(c, longnum, 0, 0, 0);
+	isup_set_generic_name(c, "ABCDEFGHIJKLMNO", 1, 1, 0);
+	queued = lb.link[0]->tx_q.len;
+	if (isup_iam(lb.ss7[0], c) != -1) {
+		printf("FAIL: oversized IAM was accepted\n");
+		failed++;
+	}
+	if (lb.link[0]->tx_q.len != queued) {
+		printf("FAIL: oversized IAM was queued\n");
+		failed++;
+	}
+
+	/* Three long numbers fit and must come out the other end */
+	c = long_call(lb.ss7[0], 2, evnum);
+	if (isup_iam(lb.ss7[0], c)) {
+		printf("FAIL: IAM with three long numbers was refused\n");
+		failed++;
+	}
+	for (i = 0; i < 100 && !got_iam; i++) {
+		lb_pump(&lb, 32);
+	}
+	if (got_iam != 1) {
+		printf("FAIL: %d IAMs received, expected 1\n", got_iam);
+		failed++;
+	} else if (strcmp(got_called, evnum) || strcmp(got_calling, evnum) || strcmp(got_charge, evnum)) {
+		printf("FAIL: numbers mangled: called %s calling %s charge %s\n", got_called, got_calling, got_charge);
+		failed++;
+	}
+
+	lb_destroy(&lb);
+
+	if (!failed) {
+		printf("PASS\n");
+	}
+	return failed ? 1 : 0;
+}
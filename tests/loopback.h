@@ -0,0 +1,155 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Two instances wired back to back through ss7_transmit_su() and
+ * ss7_receive_su(), for the tests and benchmarks.  No fds are involved.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#ifndef _LOOPBACK_H
+#define _LOOPBACK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libss7.h"
+#include "../ss7_internal.h"
+#include "../mtp2.h"
+
+struct loopback {
+	struct ss7 *ss7[2];	/* point codes 1 and 2 */
+	struct mtp2 *link[2];
+	int up[2];
+	int drop;		/* lose one MSU in drop at random, 0 for none */
+	int dropped;
+	void (*event)(struct loopback *lb, int side, ss7_event *e);
+	void *data;
+};
+
+static inline void lb_quiet(struct ss7 *ss7, char *s)
+{
+	if (getenv("LB_VERBOSE")) {
+		fprintf(stderr, "[%p] %s", (void *) ss7, s);
+	}
+}
+
+static inline void lb_call_null(struct ss7 *ss7, struct isup_call *c, int lock)
+{
+}
+
+static inline int lb_hangup(struct ss7 *ss7, int cic, unsigned int dpc, int cause, int do_hangup)
+{
+	return 0;
+}
+
+static inline void lb_notinservice(struct ss7 *ss7, int cic, unsigned int dpc)
+{
+}
+
+static inline long long lb_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* Move up to max SUs each way, run the schedulers and hand out the events.
+ * Returns the number of MSUs that crossed. */
+static inline int lb_pump(struct loopback *lb, int max)
+{
+	unsigned char buf[SS7_MAX_SU_SIZE];
+	ss7_event *e;
+	int i, n, res, msus = 0;
+
+	for (i = 0; i < 2; i++) {
+		for (n = 0; n < max; n++) {
+			res = ss7_transmit_su(lb->ss7[i], lb->link[i], buf, sizeof(buf));
+			if (res <= 0) {
+				break;
+			}
+			if ((buf[2] & 0x3f) > 2) {
+				if (lb->drop && !(rand() % lb->drop)) {
+					lb->dropped++;
+					continue;
+				}
+				msus++;
+			}
+			ss7_receive_su(lb->ss7[!i], lb->link[!i], buf, res);
+			if (!mtp2_tx_pending(lb->link[i])) {
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		ss7_schedule_run(lb->ss7[i]);
+		while ((e = ss7_check_event(lb->ss7[i]))) {
+			if (e->e == SS7_EVENT_UP) {
+				lb->up[i] = 1;
+			} else if (e->e == SS7_EVENT_DOWN) {
+				lb->up[i] = 0;
+			}
+			if (lb->event) {
+				lb->event(lb, i, e);
+			}
+		}
+	}
+
+	return msus;
+}
+
+/* Returns 0 once both sides are up, -1 if that took over ten seconds */
+static inline int lb_init(struct loopback *lb, int switchtype)
+{
+	long long start;
+	int i;
+
+	memset(lb, 0, sizeof(*lb));
+
+	ss7_set_message(lb_quiet);
+	ss7_set_error(lb_quiet);
+	ss7_set_call_null(lb_call_null);
+	ss7_set_hangup(lb_hangup);
+	ss7_set_notinservice(lb_notinservice);
+
+	for (i = 0; i < 2; i++) {
+		if (!(lb->ss7[i] = ss7_new(switchtype))) {
+			return -1;
+		}
+		ss7_set_pc(lb->ss7[i], i + 1);
+		ss7_set_network_ind(lb->ss7[i], SS7_NI_NAT);
+		lb->link[i] = ss7_add_link_handle(lb->ss7[i], SS7_TRANSPORT_DAHDIDCHAN, -1, 0, 2 - i);
+		if (!lb->link[i]) {
+			return -1;
+		}
+		/* Short proving period, nothing to prove here */
+		lb->link[i]->timers.t4 = 100;
+	}
+
+	ss7_start(lb->ss7[0]);
+	ss7_start(lb->ss7[1]);
+
+	start = lb_now_us();
+	while (!(lb->up[0] && lb->up[1])) {
+		if (lb_now_us() - start > 10000000) {
+			return -1;
+		}
+		lb_pump(lb, 32);
+	}
+
+	return 0;
+}
+
+static inline void lb_destroy(struct loopback *lb)
+{
+	ss7_destroy(lb->ss7[0]);
+	ss7_destroy(lb->ss7[1]);
+}
+
+#endif /* _LOOPBACK_H */
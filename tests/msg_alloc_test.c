@@ -0,0 +1,177 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Once the message pool has filled, a steady stream of calls must not
+ * allocate anything but the calls themselves: no message buffers, and no
+ * ISUP timer parameters.  Linked with malloc() and calloc() wrapped.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include "loopback.h"
+#include "../isup.h"
+
+#define WARMUP	50
+#define CALLS	500
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+
+static int counting;
+static unsigned int allocs, other_allocs;
+
+void *__wrap_malloc(size_t size)
+{
+	if (counting) {
+		allocs++;
+		other_allocs += size != sizeof(struct isup_call);
+	}
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	if (counting) {
+		allocs++;
+		other_allocs += nmemb * size != sizeof(struct isup_call);
+	}
+	return __real_calloc(nmemb, size);
+}
+
+static int done;
+
+/* IAM, ACM, ANM, REL, RLC */
+static void call_event(struct loopback *lb, int side, ss7_event *e)
+{
+	struct ss7 *ss7 = lb->ss7[side];
+
+	switch (e->e) {
+	case ISUP_EVENT_IAM:
+		isup_acm(ss7, e->iam.call);
+		isup_anm(ss7, e->iam.call);
+		break;
+	case ISUP_EVENT_ANM:
+		isup_rel(ss7, e->anm.call, 16);
+		break;
+	case ISUP_EVENT_REL:
+		isup_rlc(ss7, e->rel.call);
+		isup_free_call_if_clear(ss7, e->rel.call);
+		break;
+	case ISUP_EVENT_RLC:
+		isup_free_call_if_clear(ss7, e->rlc.call);
+		done++;
+		break;
+	}
+}
+
+static int run_calls(struct loopback *lb, int n)
+{
+	struct isup_call *c;
+	int i, j;
+
+	for (i = 0; i < n; i++) {
+		c = isup_new_call(lb->ss7[0], 1 + i % 24, 2, 0);
+		isup_set_called(c, "5551234", SS7_NAI_NATIONAL, lb->ss7[0]);
+		isup_set_calling(c, "5554321", SS7_NAI_NATIONAL, SS7_PRESENTATION_ALLOWED, SS7_SCREENING_USER_PROVIDED);
+		done = 0;
+		if (isup_iam(lb->ss7[0], c)) {
+			return -1;
+		}
+		for (j = 0; j < 100 && !done; j++) {
+			lb_pump(lb, 32);
+		}
+		if (!done) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void msg_totals(struct ss7 *ss7, unsigned int *msgs, unsigned int *mallocs)
+{
+	int i;
+
+	*msgs = *mallocs = 0;
+	for (i = 0; i < SS7_MSG_CLASSES; i++) {
+		*msgs += ss7->msg_allocs[i];
+		*mallocs += ss7->msg_mallocs[i];
+	}
+}
+
+int main(void)
+{
+	struct loopback lb;
+	unsigned int msg_allocs[2], msg_mallocs[2], msgs, mallocs, timers;
+	int side, failed = 0;
+
+	if (lb_init(&lb, SS7_ITU)) {
+		printf("FAIL: link did not come up\n");
+		return 1;
+	}
+	lb.event = call_event;
+	/* ISUP timers are off unless configured */
+	for (side = 0; side < 2; side++) {
+		ss7_set_isup_timer(lb.ss7[side], "t1", 15000);
+		ss7_set_isup_timer(lb.ss7[side], "t5", 300000);
+		ss7_set_isup_timer(lb.ss7[side], "t7", 20000);
+		ss7_set_timer_stats(lb.ss7[side], 1);
+	}
+
+	if (run_calls(&lb, WARMUP)) {
+		printf("FAIL: warm-up call did not complete\n");
+		return 1;
+	}
+
+	for (side = 0; side < 2; side++) {
+		msg_totals(lb.ss7[side], &msg_allocs[side], &msg_mallocs[side]);
+	}
+	timers = lb.ss7[0]->timer_stats[SS7_TIMER_ISUP(ISUP_TIMER_T7)].started +
+		lb.ss7[0]->timer_stats[SS7_TIMER_ISUP(ISUP_TIMER_T1)].started;
+
+	counting = 1;
+	if (run_calls(&lb, CALLS)) {
+		printf("FAIL: call did not complete\n");
+		return 1;
+	}
+	counting = 0;
+	timers = lb.ss7[0]->timer_stats[SS7_TIMER_ISUP(ISUP_TIMER_T7)].started +
+		lb.ss7[0]->timer_stats[SS7_TIMER_ISUP(ISUP_TIMER_T1)].started - timers;
+
+	for (side = 0; side < 2; side++) {
+		msg_totals(lb.ss7[side], &msgs, &mallocs);
+		msg_allocs[side] = msgs - msg_allocs[side];
+		msg_mallocs[side] = mallocs - msg_mallocs[side];
+	}
+	printf("%d calls: %u/%u messages and %u/%u of them malloc()ed, %u ISUP timers, %u allocations (%u not calls)\n",
+		CALLS, msg_allocs[0], msg_allocs[1], msg_mallocs[0], msg_mallocs[1], timers, allocs, other_allocs);
+
+	if (msg_allocs[0] < CALLS || msg_allocs[1] < CALLS) {
+		printf("FAIL: messages not counted\n");
+		failed++;
+	}
+	if (timers < 2 * CALLS) {
+		printf("FAIL: ISUP timers not started\n");
+		failed++;
+	}
+	if (msg_mallocs[0] || msg_mallocs[1]) {
+		printf("FAIL: message buffers allocated after warm-up\n");
+		failed++;
+	}
+	/* One call on each side */
+	if (other_allocs || allocs != 2 * CALLS) {
+		printf("FAIL: expected %d call allocations and nothing else\n", 2 * CALLS);
+		failed++;
+	}
+
+	lb_destroy(&lb);
+
+	if (!failed) {
+		printf("PASS\n");
+	}
+	return failed ? 1 : 0;
+}
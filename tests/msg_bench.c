@@ -0,0 +1,74 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Heap taken by a transmit backlog: 10000 ISUP MSUs, an IAM, ACM, ANM, REL
+ * and RLC per call, queued on a link that is not sending, as a changeover
+ * backlog would hold them.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "../libss7.h"
+#include "../ss7_internal.h"
+#include "../mtp2.h"
+#include "../mtp3.h"
+
+#define MSUS	10000
+
+static struct isup_call *calls[MSUS / 5];
+
+static void quiet(struct ss7 *ss7, char *s)
+{
+}
+
+static void call_null(struct ss7 *ss7, struct isup_call *c, int lock)
+{
+}
+
+int main(void)
+{
+	struct ss7 *ss7;
+	struct mtp2 *link;
+	size_t before, after;
+	int i;
+
+	ss7_set_message(quiet);
+	ss7_set_error(quiet);
+	ss7_set_call_null(call_null);
+
+	ss7 = ss7_new(SS7_ITU);
+	ss7_set_pc(ss7, 1);
+	ss7_add_link(ss7, SS7_TRANSPORT_DAHDIDCHAN, -1, 0, 2);
+	link = ss7->links[0];
+	/* In service as far as MTP3 knows, but nothing is written out */
+	ss7->mtp2_linkstate[0] = MTP2_LINKSTATE_UP;
+	link->adj_sp->state = MTP3_UP;
+	link->state = MTP_INSERVICE;
+
+	for (i = 0; i < MSUS / 5; i++) {
+		calls[i] = isup_new_call(ss7, 1 + i, 2, 0);
+		isup_set_called(calls[i], "4045551234", SS7_NAI_NATIONAL, ss7);
+		isup_set_calling(calls[i], "4045554321", SS7_NAI_NATIONAL, SS7_PRESENTATION_ALLOWED, SS7_SCREENING_USER_PROVIDED);
+	}
+
+	before = mallinfo2().uordblks;
+	for (i = 0; i < MSUS / 5; i++) {
+		isup_iam(ss7, calls[i]);
+		isup_acm(ss7, calls[i]);
+		isup_anm(ss7, calls[i]);
+		isup_rel(ss7, calls[i], 16);
+		isup_rlc(ss7, calls[i]);
+	}
+	after = mallinfo2().uordblks;
+
+	printf("%d MSUs queued: heap grew by %.2f MB, %zu bytes per MSU\n",
+		MSUS, (after - before) / 1e6, (after - before) / MSUS);
+
+	return 0;
+}
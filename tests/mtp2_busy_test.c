@@ -0,0 +1,107 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * The receiving side stops taking events for longer than T7 while MSUs keep
+ * coming and some get lost.  The link must stay up on SIB and every MSU must
+ * be delivered exactly once after the backlog drains.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include "loopback.h"
+
+#define MSUS	2000
+
+static int blo[MSUS + 1], downs;
+
+static void busy_event(struct loopback *lb, int side, ss7_event *e)
+{
+	if (e->e == SS7_EVENT_DOWN || e->e == MTP2_LINK_DOWN) {
+		downs++;
+	}
+	if (side == 1 && e->e == ISUP_EVENT_BLO && e->blo.cic <= MSUS) {
+		blo[e->blo.cic]++;
+	}
+}
+
+/* Like lb_pump(), but side 1 leaves its events queued */
+static void pump_stalled(struct loopback *lb)
+{
+	unsigned char buf[SS7_MAX_SU_SIZE];
+	int i, n, res;
+
+	for (i = 0; i < 2; i++) {
+		for (n = 0; n < 8; n++) {
+			res = ss7_transmit_su(lb->ss7[i], lb->link[i], buf, sizeof(buf));
+			if (res <= 0) {
+				break;
+			}
+			if ((buf[2] & 0x3f) > 2 && lb->drop && !(rand() % lb->drop)) {
+				lb->dropped++;
+				continue;
+			}
+			ss7_receive_su(lb->ss7[!i], lb->link[!i], buf, res);
+		}
+		ss7_schedule_run(lb->ss7[i]);
+	}
+	while (ss7_check_event(lb->ss7[0])) {
+	}
+}
+
+int main(void)
+{
+	struct loopback lb;
+	struct isup_call *c;
+	long long start;
+	int i, missing = 0, dups = 0;
+
+	srand(1);
+	if (lb_init(&lb, SS7_ITU)) {
+		printf("FAIL: link did not come up\n");
+		return 1;
+	}
+	lb.event = busy_event;
+	lb.drop = 20;
+	ss7_set_event_watermarks(lb.ss7[1], 200, 50);
+
+	for (i = 1; i <= MSUS; i++) {
+		c = isup_new_call(lb.ss7[0], i, 2, 0);
+		isup_blo(lb.ss7[0], c);
+	}
+
+	/* Twice the default T7 */
+	start = lb_now_us();
+	while (lb_now_us() - start < 2 * lb.link[0]->timers.t7 * 1000LL) {
+		pump_stalled(&lb);
+	}
+	if (!lb.ss7[1]->ev_throttled) {
+		printf("FAIL: backlog of %d events did not make the link busy\n", lb.ss7[1]->ev_len);
+		return 1;
+	}
+
+	start = lb_now_us();
+	while (lb_now_us() - start < 10000000) {
+		lb_pump(&lb, 32);
+		for (i = 1; i <= MSUS && blo[i]; i++);
+		if (i > MSUS) {
+			break;
+		}
+	}
+
+	for (i = 1; i <= MSUS; i++) {
+		missing += !blo[i];
+		dups += blo[i] > 1;
+	}
+	printf("%d MSUs lost on the way, %d missing, %d duplicated, link down %d times\n", lb.dropped, missing, dups, downs);
+	lb_destroy(&lb);
+
+	if (missing || dups || downs) {
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
@@ -0,0 +1,266 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Receive batching: two instances joined by two AF_UNIX SOCK_SEQPACKET
+ * links.  10000 BLOs are queued on one side and timed until the other side
+ * has taken all of them, counting the receiver's POLLIN wakeups and read
+ * syscalls (read() and recvmmsg() are wrapped).  The second run loses one
+ * MSU in four on the receiving side to exercise retransmission.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../libss7.h"
+#include "../ss7_internal.h"
+#include "../mtp2.h"
+
+#define LINKS	2
+#define MSUS	10000
+
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __wrap_read(int fd, void *buf, size_t count);
+int __real_recvmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen, int flags, struct timespec *timeout);
+int __wrap_recvmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen, int flags, struct timespec *timeout);
+
+static struct ss7 *node[2];
+static int fds[2][LINKS];
+static int up[2], blos;
+static long wakeups, reads;
+static int droprate, dropped;
+
+static int rx_fd(int fd)
+{
+	int j;
+
+	for (j = 0; j < LINKS; j++) {
+		if (fd == fds[1][j]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Lose this frame?  Only MSUs, so the link stays aligned. */
+static int lose(const unsigned char *buf, int len)
+{
+	if (!droprate || len < 5 || (buf[2] & 0x3f) <= 2 || rand() % droprate) {
+		return 0;
+	}
+	dropped++;
+	return 1;
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+	ssize_t res;
+
+	if (!rx_fd(fd)) {
+		return __real_read(fd, buf, count);
+	}
+	/* The fds are non-blocking, so reading past a lost frame is safe */
+	do {
+		reads++;
+		res = __real_read(fd, buf, count);
+	} while (res > 0 && lose(buf, res));
+
+	return res;
+}
+
+int __wrap_recvmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen, int flags, struct timespec *timeout)
+{
+	int res, i, kept = 0;
+
+	if (!rx_fd(fd)) {
+		return __real_recvmmsg(fd, msgs, vlen, flags, timeout);
+	}
+	reads++;
+	res = __real_recvmmsg(fd, msgs, vlen, flags, timeout);
+
+	/* Close up the gaps left by lost frames */
+	for (i = 0; i < res; i++) {
+		if (lose(msgs[i].msg_hdr.msg_iov->iov_base, msgs[i].msg_len)) {
+			continue;
+		}
+		if (kept != i) {
+			memcpy(msgs[kept].msg_hdr.msg_iov->iov_base, msgs[i].msg_hdr.msg_iov->iov_base, msgs[i].msg_len);
+			msgs[kept].msg_len = msgs[i].msg_len;
+		}
+		kept++;
+	}
+	if (res > 0 && !kept) {
+		errno = EAGAIN;
+		return -1;
+	}
+	return res > 0 ? kept : res;
+}
+
+static void call_null(struct ss7 *ss7, struct isup_call *c, int lock)
+{
+}
+
+static int hangup(struct ss7 *ss7, int cic, unsigned int dpc, int cause, int do_hangup)
+{
+	return 0;
+}
+
+static void notinservice(struct ss7 *ss7, int cic, unsigned int dpc)
+{
+}
+
+static void quiet(struct ss7 *ss7, char *s)
+{
+}
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void pump(int ms)
+{
+	struct pollfd p[2 * LINKS];
+	ss7_event *e;
+	int i, j, k, next;
+
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < LINKS; j++) {
+			p[i * LINKS + j].fd = fds[i][j];
+			p[i * LINKS + j].events = ss7_pollflags(node[i], fds[i][j]);
+		}
+		next = ss7_schedule_next_ms(node[i]);
+		if (next > -1 && next < ms) {
+			ms = next;
+		}
+	}
+	poll(p, 2 * LINKS, ms);
+
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < LINKS; j++) {
+			k = i * LINKS + j;
+			if (p[k].revents & POLLIN) {
+				wakeups += i;
+				ss7_read(node[i], fds[i][j]);
+			}
+			if (p[k].revents & POLLOUT) {
+				ss7_write(node[i], fds[i][j]);
+			}
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		ss7_schedule_run(node[i]);
+		while ((e = ss7_check_event(node[i]))) {
+			if (e->e == SS7_EVENT_UP) {
+				up[i] = 1;
+			} else if (e->e == ISUP_EVENT_BLO && i == 1) {
+				blos++;
+			}
+		}
+	}
+}
+
+static int bench(int drop)
+{
+	struct isup_call *c;
+	long long t0;
+	int i;
+
+	dropped = 0;
+	blos = 0;
+	wakeups = reads = 0;
+	for (i = 0; i < MSUS; i++) {
+		c = isup_new_call(node[0], 1 + i % 30, 2, 0);
+		isup_blo(node[0], c);
+	}
+
+	droprate = drop;
+	t0 = now_us();
+	while (blos < MSUS && now_us() - t0 < 60000000) {
+		pump(10);
+	}
+	t0 = now_us() - t0;
+	droprate = 0;
+
+	printf("%-15s POLLIN wakeups/MSU %.3f  read syscalls/MSU %.3f  %.0f MSU/s  (%d/%d delivered, %d lost)\n",
+		drop ? "1 in 4 lost" : "no loss", (double) wakeups / MSUS, (double) reads / MSUS,
+		blos / (t0 / 1e6), blos, MSUS, dropped);
+
+	/* Let the acks settle before the next run */
+	for (i = 0; i < 100; i++) {
+		pump(1);
+	}
+	return blos < MSUS;
+}
+
+int main(void)
+{
+	long long t0;
+	int sv[2], size = 4 << 20, i, j, k, res;
+
+	ss7_set_call_null(call_null);
+	ss7_set_hangup(hangup);
+	ss7_set_notinservice(notinservice);
+	ss7_set_message(quiet);
+	ss7_set_error(quiet);
+
+	for (i = 0; i < 2; i++) {
+		node[i] = ss7_new(SS7_ITU);
+		ss7_set_pc(node[i], i + 1);
+		ss7_set_network_ind(node[i], SS7_NI_NAT);
+	}
+	for (j = 0; j < LINKS; j++) {
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+			printf("FAIL: socketpair\n");
+			return 1;
+		}
+		for (k = 0; k < 2; k++) {
+			setsockopt(sv[k], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+			fcntl(sv[k], F_SETFL, O_NONBLOCK);
+			fds[k][j] = sv[k];
+		}
+		ss7_add_link(node[0], SS7_TRANSPORT_DAHDIDCHAN, sv[0], j, 2);
+		ss7_add_link(node[1], SS7_TRANSPORT_DAHDIDCHAN, sv[1], j, 1);
+		/* Short proving period, nothing to prove here */
+		node[0]->links[j]->timers.t4 = 100;
+		node[1]->links[j]->timers.t4 = 100;
+	}
+
+	ss7_start(node[0]);
+	ss7_start(node[1]);
+	t0 = now_us();
+	while (!(up[0] && up[1])) {
+		if (now_us() - t0 > 20000000) {
+			printf("FAIL: links did not come up\n");
+			return 1;
+		}
+		pump(50);
+	}
+	for (i = 0; i < 1000; i++) {
+		pump(1);
+	}
+
+	res = bench(0) || bench(4);
+
+	ss7_destroy(node[0]);
+	ss7_destroy(node[1]);
+	if (res) {
+		printf("FAIL: not all BLOs delivered\n");
+	}
+	return res;
+}
@@ -0,0 +1,103 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Scheduler cost per operation with 10k and 100k timers armed: arming,
+ * deleting, ss7_schedule_next_ms() and running expired ones.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../libss7.h"
+#include "../ss7_internal.h"
+
+static int ran;
+
+static void quiet(struct ss7 *ss7, char *s)
+{
+}
+
+static void fire(void *data)
+{
+	ran++;
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *what, int n, long long ns)
+{
+	printf("  %-10s %8.1f ns/op\n", what, (double) ns / n);
+}
+
+static int bench(int n)
+{
+	struct ss7 *ss7;
+	long long *ids, tmp;
+	int i, j, sum = 0;
+	long long start;
+
+	if (!(ss7 = ss7_new(SS7_ITU)) || !(ids = malloc(n * sizeof(*ids)))) {
+		return -1;
+	}
+	printf("%d timers:\n", n);
+
+	/* Spread over T1-ish deadlines, as ISUP timers on idle circuits are */
+	start = now_ns();
+	for (i = 0; i < n; i++) {
+		ids[i] = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 10000 + rand() % 50000, fire, NULL);
+	}
+	report("schedule", n, now_ns() - start);
+
+	start = now_ns();
+	for (i = 0; i < n; i++) {
+		sum += ss7_schedule_next_ms(ss7);
+	}
+	report("next", n, now_ns() - start);
+
+	/* Delete in random order, then arm again so the heap is full for run */
+	for (i = n - 1; i > 0; i--) {
+		j = rand() % (i + 1);
+		tmp = ids[i];
+		ids[i] = ids[j];
+		ids[j] = tmp;
+	}
+	start = now_ns();
+	for (i = 0; i < n; i++) {
+		ss7_schedule_del(ss7, &ids[i]);
+	}
+	report("cancel", n, now_ns() - start);
+
+	for (i = 0; i < n; i++) {
+		ids[i] = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 0, fire, NULL);
+	}
+	ran = 0;
+	start = now_ns();
+	ss7_schedule_run(ss7);
+	report("run", ran, now_ns() - start);
+
+	free(ids);
+	ss7_destroy(ss7);
+	return sum < 0;
+}
+
+int main(void)
+{
+	ss7_set_error(quiet);
+	srand(1);
+	if (bench(10000) || bench(100000)) {
+		printf("FAIL\n");
+		return 1;
+	}
+	return 0;
+}
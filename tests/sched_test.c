@@ -0,0 +1,177 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Scheduler: expiry order, deleting and looking up ids that are no longer
+ * armed, the end of an ss7_clock_tick() pass, growing the slot array and the
+ * ss7_set_max_timers() limit.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../libss7.h"
+#include "../ss7_internal.h"
+
+#define TIMERS	5000
+
+static int fired[TIMERS], order[TIMERS], nfired;
+static int ms[TIMERS];
+static long long ids[TIMERS];
+
+static void quiet(struct ss7 *ss7, char *s)
+{
+}
+
+static void fire(void *data)
+{
+	int i = (int) (long) data;
+
+	fired[i]++;
+	order[nfired++] = i;
+}
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			printf("FAIL: " __VA_ARGS__); \
+			printf("\n"); \
+			return 1; \
+		} \
+	} while (0)
+
+/* Timers fire once, earliest first and in scheduling order on a tie, and
+ * deleted ones don't fire.  5000 timers also grow the slot array a few times. */
+static int test_order(struct ss7 *ss7)
+{
+	int i, a, b;
+
+	/* One clock reading for all of them, so only ms decides the order */
+	ss7_clock_tick(ss7);
+	for (i = 0; i < TIMERS; i++) {
+		ms[i] = 20 + rand() % 50;
+		ids[i] = ss7_schedule_event(ss7, SS7_TIMER_OTHER, ms[i], fire, (void *) (long) i);
+		CHECK(ids[i] > 0, "schedule %d returned %lld", i, ids[i]);
+	}
+	ss7_schedule_run(ss7);
+	CHECK(ss7->sched_size > TIMERS, "slot array did not grow (%d slots)", ss7->sched_size);
+
+	for (i = 0; i < TIMERS; i += 3) {
+		ss7_schedule_del(ss7, &ids[i]);
+		CHECK(ids[i] == -1, "deleted id not reset");
+	}
+
+	nfired = 0;
+	usleep(100000);
+	ss7_schedule_run(ss7);
+	CHECK(!ss7->sched_len, "%d timers left armed", ss7->sched_len);
+
+	for (i = 0; i < TIMERS; i++) {
+		CHECK(fired[i] == (i % 3 ? 1 : 0), "timer %d fired %d times", i, fired[i]);
+	}
+	for (i = 1; i < nfired; i++) {
+		a = order[i - 1];
+		b = order[i];
+		CHECK(ms[a] < ms[b] || (ms[a] == ms[b] && a < b),
+			"timer %d (%d ms) fired after %d (%d ms)", b, ms[b], a, ms[a]);
+	}
+	return 0;
+}
+
+/* An id that ran or was deleted must not reach whatever reuses its slot */
+static int test_stale(struct ss7 *ss7)
+{
+	long long old, stale, id;
+	int i;
+
+	old = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 1000, fire, (void *) 1L);
+	stale = old;
+	ss7_schedule_del(ss7, &old);
+
+	/* The freed slot is the next one handed out */
+	id = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 1000, fire, (void *) 2L);
+	CHECK(id != stale, "reused slot gave the same id");
+	CHECK(!ss7_schedule_data(ss7, stale), "stale id still finds data");
+	CHECK(ss7_schedule_ms_left(ss7, stale) == -1, "stale id still has time left");
+	old = stale;
+	ss7_schedule_del(ss7, &old);
+	CHECK(ss7_schedule_data(ss7, id) == (void *) 2L, "deleting a stale id cancelled its slot's new timer");
+
+	/* Far more reuses of the same slot than an 11-bit generation survives */
+	for (i = 0; i < 100000; i++) {
+		ss7_schedule_del(ss7, &id);
+		id = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 1000, fire, (void *) 2L);
+		CHECK(id > 0 && id != stale, "id of a deleted timer came back after %d reuses", i + 1);
+	}
+	CHECK(!ss7_schedule_data(ss7, stale), "stale id finds data after reuse");
+
+	ss7_schedule_del(ss7, &id);
+	CHECK(!ss7->sched_len, "%d timers left armed", ss7->sched_len);
+	return 0;
+}
+
+/* A tick the application never follows with ss7_schedule_run() must not
+ * outlive the event loop pass */
+static int test_tick(struct ss7 *ss7)
+{
+	long long id;
+	int left;
+
+	ss7_clock_tick(ss7);
+	usleep(100000);
+	CHECK(!ss7_check_event(ss7), "unexpected event");
+	id = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 50, fire, NULL);
+	left = ss7_schedule_next_ms(ss7);
+	CHECK(left > 40 && left <= 50, "timer armed after the pass is due in %d ms, not 50", left);
+	ss7_schedule_del(ss7, &id);
+	return 0;
+}
+
+/* Never more than sched_max armed, even after the array grew past it */
+static int test_max(struct ss7 *ss7)
+{
+	long long id;
+	int i;
+
+	ss7_set_max_timers(ss7, 100);
+	for (i = 0; i < 100; i++) {
+		ids[i] = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 1000, fire, NULL);
+		CHECK(ids[i] > 0, "timer %d of 100 refused", i);
+	}
+	id = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 1000, fire, NULL);
+	CHECK(id == -1, "timer 101 of 100 accepted");
+
+	ss7_schedule_del(ss7, &ids[0]);
+	ids[0] = ss7_schedule_event(ss7, SS7_TIMER_OTHER, 1000, fire, NULL);
+	CHECK(ids[0] > 0, "freed room not reused");
+
+	for (i = 0; i < 100; i++) {
+		ss7_schedule_del(ss7, &ids[i]);
+	}
+	ss7_set_max_timers(ss7, 0);
+	return 0;
+}
+
+int main(void)
+{
+	struct ss7 *ss7;
+
+	ss7_set_error(quiet);
+	srand(1);
+	if (!(ss7 = ss7_new(SS7_ITU))) {
+		printf("FAIL: ss7_new\n");
+		return 1;
+	}
+
+	if (test_order(ss7) || test_stale(ss7) || test_tick(ss7) || test_max(ss7)) {
+		return 1;
+	}
+
+	ss7_destroy(ss7);
+	printf("PASS\n");
+	return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Caller-driven I/O: 20000 queued BLOs from one instance to another, once
+ * through ss7_transmit_su()/ss7_receive_su() with no fds at all and once
+ * over a non-blocking AF_UNIX SOCK_SEQPACKET pair through ss7_write() and
+ * ss7_read().
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "loopback.h"
+
+#define MSUS	20000
+
+static int fds[2], blos;
+
+static void blo_event(struct loopback *lb, int side, ss7_event *e)
+{
+	if (side == 1 && e->e == ISUP_EVENT_BLO) {
+		blos++;
+	}
+}
+
+/* lb_pump(), but through the fds */
+static void fd_pump(struct loopback *lb)
+{
+	struct pollfd p[2];
+	ss7_event *e;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		p[i].fd = fds[i];
+		p[i].events = ss7_pollflags(lb->ss7[i], fds[i]);
+	}
+	poll(p, 2, 10);
+
+	for (i = 0; i < 2; i++) {
+		if (p[i].revents & POLLIN) {
+			ss7_read(lb->ss7[i], fds[i]);
+		}
+		if (p[i].revents & POLLOUT) {
+			ss7_write(lb->ss7[i], fds[i]);
+		}
+	}
+	for (i = 0; i < 2; i++) {
+		ss7_schedule_run(lb->ss7[i]);
+		while ((e = ss7_check_event(lb->ss7[i]))) {
+			if (e->e == SS7_EVENT_UP) {
+				lb->up[i] = 1;
+			}
+			blo_event(lb, i, e);
+		}
+	}
+}
+
+/* Like lb_init(), with the links on a socketpair */
+static int fd_init(struct loopback *lb)
+{
+	int i, size = 4 << 20;
+	long long start;
+
+	memset(lb, 0, sizeof(*lb));
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds)) {
+		return -1;
+	}
+	for (i = 0; i < 2; i++) {
+		setsockopt(fds[i], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+		fcntl(fds[i], F_SETFL, O_NONBLOCK);
+		lb->ss7[i] = ss7_new(SS7_ITU);
+		ss7_set_pc(lb->ss7[i], i + 1);
+		ss7_set_network_ind(lb->ss7[i], SS7_NI_NAT);
+		lb->link[i] = ss7_add_link_handle(lb->ss7[i], SS7_TRANSPORT_DAHDIDCHAN, fds[i], 0, 2 - i);
+		lb->link[i]->timers.t4 = 100;
+	}
+	ss7_start(lb->ss7[0]);
+	ss7_start(lb->ss7[1]);
+
+	start = lb_now_us();
+	while (!(lb->up[0] && lb->up[1])) {
+		if (lb_now_us() - start > 10000000) {
+			return -1;
+		}
+		fd_pump(lb);
+	}
+	return 0;
+}
+
+static int bench(struct loopback *lb, int use_fds)
+{
+	struct isup_call *c;
+	long long start;
+	int i;
+
+	blos = 0;
+	for (i = 0; i < MSUS; i++) {
+		c = isup_new_call(lb->ss7[0], 1 + i % 30, 2, 0);
+		isup_blo(lb->ss7[0], c);
+	}
+
+	start = lb_now_us();
+	while (blos < MSUS && lb_now_us() - start < 30000000) {
+		if (use_fds) {
+			fd_pump(lb);
+		} else {
+			lb_pump(lb, 32);
+		}
+	}
+	printf("%-32s %d/%d BLOs in %.1f ms\n", use_fds ? "ss7_write()/ss7_read(), socketpair" : "ss7_transmit_su()/ss7_receive_su()",
+		blos, MSUS, (lb_now_us() - start) / 1000.0);
+
+	return blos < MSUS;
+}
+
+int main(void)
+{
+	struct loopback lb;
+	unsigned char buf[SS7_MAX_SU_SIZE];
+	int res;
+
+	if (lb_init(&lb, SS7_ITU)) {
+		printf("FAIL: link did not come up\n");
+		return 1;
+	}
+	lb.event = blo_event;
+	/* Both must be refused without touching the link */
+	if (ss7_transmit_su(lb.ss7[0], lb.link[0], buf, sizeof(buf) - 1) != -1 ||
+		ss7_transmit_su(lb.ss7[0], lb.link[1], buf, sizeof(buf)) != -1) {
+		printf("FAIL: short buffer or foreign link accepted\n");
+		return 1;
+	}
+	res = bench(&lb, 0);
+	lb_destroy(&lb);
+
+	if (fd_init(&lb)) {
+		printf("FAIL: link did not come up\n");
+		return 1;
+	}
+	res |= bench(&lb, 1);
+	lb_destroy(&lb);
+	close(fds[0]);
+	close(fds[1]);
+
+	return res;
+}
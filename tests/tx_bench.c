@@ -0,0 +1,135 @@
+/*
+ * libss7: An implementation of Signalling System 7
+ *
+ * Transmit batching: queue bursts of MSUs on one link over an AF_UNIX
+ * SOCK_SEQPACKET pair and flush them with poll(POLLOUT) + ss7_write() until
+ * the queue is empty.  The far end is drained and everything acked between
+ * bursts.  Counts ss7_write() calls, i.e. POLLOUT wakeups, and write()s,
+ * which are wrapped (-Wl,--wrap=write).
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2 as published by the
+ * Free Software Foundation. See the LICENSE file included with
+ * this program for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "../libss7.h"
+#include "../ss7_internal.h"
+#include "../mtp2.h"
+
+#define ROUNDS	2000
+
+ssize_t __real_write(int fd, const void *buf, size_t count);
+ssize_t __wrap_write(int fd, const void *buf, size_t count);
+
+static int txfd = -1;
+static long writes;
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count)
+{
+	if (fd == txfd) {
+		writes++;
+	}
+	return __real_write(fd, buf, count);
+}
+
+static void quiet(struct ss7 *ss7, char *s)
+{
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int bench(int burst, int blocking)
+{
+	struct ss7 *ss7;
+	struct mtp2 *link;
+	struct mtp_su_head *h;
+	struct ss7_msg *m;
+	struct pollfd p;
+	unsigned char buf[SS7_MAX_SU_SIZE];
+	long calls = 0, msus = 0;
+	long long t0, elapsed = 0;
+	int sv[2], size = 4 << 20, r, i;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+		return -1;
+	}
+	setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	if (!blocking) {
+		fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	}
+
+	ss7 = ss7_new(SS7_ITU);
+	ss7_set_pc(ss7, 1);
+	link = ss7_add_link_handle(ss7, SS7_TRANSPORT_DAHDIDCHAN, sv[0], 0, 2);
+	link->state = MTP_INSERVICE;
+	link->autotxsutype = FISU;
+	txfd = sv[0];
+	writes = 0;
+
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < burst; i++) {
+			m = ss7_msg_new(ss7, 20);
+			ss7_msg_userpart_len(m, 20);
+			mtp2_msu(link, m);
+		}
+
+		t0 = now_ns();
+		while (mtp2_tx_pending(link)) {
+			p.fd = sv[0];
+			p.events = POLLOUT;
+			poll(&p, 1, -1);
+			ss7_write(ss7, sv[0]);
+			calls++;
+		}
+		elapsed += now_ns() - t0;
+		msus += burst;
+
+		/* Drain the far end and ack everything sent */
+		while (recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT) > 0);
+		memset(buf, 0, 5);
+		h = (struct mtp_su_head *) buf;
+		h->bsn = link->curfsn;
+		h->bib = link->curfib;
+		h->fib = link->curbib;
+		h->fsn = link->lastfsnacked;
+		mtp2_receive(link, buf, 5);
+	}
+
+	printf("%-12s burst %-4d ss7_write()/MSU %.3f  write()/MSU %.3f  syscalls/MSU %.2f  %.2fM MSU/s\n",
+		blocking ? "blocking" : "non-blocking", burst, (double) calls / msus, (double) writes / msus,
+		(double) (calls + writes) / msus, msus / (elapsed / 1e9) / 1e6);
+
+	txfd = -1;
+	ss7_destroy(ss7);
+	close(sv[0]);
+	close(sv[1]);
+	return 0;
+}
+
+int main(void)
+{
+	ss7_set_message(quiet);
+	ss7_set_error(quiet);
+
+	if (bench(1, 0) || bench(10, 0) || bench(100, 0) || bench(100, 1)) {
+		printf("FAIL: socketpair\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,14 @@
+/*
+ * version.c
+ * Automatically generated
+ */
+
+#include "libss7.h"
+
+static const char ss7_version[] = "";
+
+const char *ss7_get_version(void)
+{
+	return ss7_version;
+}
+